@@ -0,0 +1,199 @@
+/**
+ * @file bench-csim.c
+ * @brief Measures the throughput of a cache simulator
+ *
+ * This program generates synthetic traces with tracegen-syn, runs the
+ * simulator over each of them for several cache geometries, and reports
+ * the simulated accesses per second, so that changes that slow down the
+ * simulator show up as numbers.
+ */
+
+#define _XOPEN_SOURCE 700 // mkdtemp, clock_gettime
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STR 1024 /* Max string size */
+
+/** @brief Synthetic traces used by the benchmark */
+typedef struct {
+    const char *name; /* name shown in the report */
+    const char *args; /* arguments to tracegen-syn, besides -n and -o */
+} bench_trace_t;
+
+static const bench_trace_t TRACES[] = {
+    {"seq", "-p seq -f 4194304 -w 0.2"},
+    {"stride", "-p stride -f 4194304 -S 4096 -w 0.2"},
+    {"random", "-p random -f 4194304 -w 0.2"},
+    {"zipf", "-p zipf -f 4194304 -z 0.99 -w 0.2"},
+    {"chase", "-p chase -f 4194304"},
+    {"tile", "-p tile -f 4194304 -k 8 -w 0.5"},
+};
+
+/** @brief Cache geometries used by the benchmark */
+typedef struct {
+    int s;
+    int E;
+    int b;
+} bench_geom_t;
+
+static const bench_geom_t GEOMS[] = {
+    {5, 1, 5},   /* the graded csim configuration */
+    {6, 8, 6},   /* Haswell L1 */
+    {10, 16, 6}, /* 1 MB, 16-way */
+    {4, 256, 6}, /* highly associative */
+};
+
+#define NTRACES (sizeof(TRACES) / sizeof(TRACES[0]))
+#define NGEOMS (sizeof(GEOMS) / sizeof(GEOMS[0]))
+
+/**
+ * @brief Returns the current monotonic time in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Runs a shell command.
+ *
+ * @return false if the command could not be run or failed, true if OK.
+ */
+static bool run(const char *cmd) {
+    int status = system(cmd);
+    if (status < 0) {
+        fprintf(stderr, "Error invoking '%s': %s\n", cmd, strerror(errno));
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error running '%s'\n", cmd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] [-n <count>] [-r <reps>] [-c <csim>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -n <count>  Accesses per synthetic trace (default 1000000)\n");
+    printf("  -r <reps>   Repetitions per point, best is kept (default 3)\n");
+    printf("  -c <csim>   Simulator to benchmark (default ./csim)\n");
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    unsigned long accesses = 1000000;
+    int reps = 3;
+    const char *csim = "./csim";
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:r:c:")) != -1) {
+        switch (c) {
+        case 'n':
+            accesses = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'c':
+            csim = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (accesses == 0 || reps < 1) {
+        printf("Error: count and reps must be positive\n");
+        usage(argv);
+        exit(1);
+    }
+
+    char dir[] = "/tmp/bench-csim.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Error creating trace directory: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    char cmd[2 * MAX_STR];
+    char trace[MAX_STR];
+    bool ok = true;
+
+    /* Generate all traces up front so that generation is not timed */
+    for (size_t t = 0; t < NTRACES && ok; t++) {
+        snprintf(trace, sizeof(trace), "%s/%s.trace", dir, TRACES[t].name);
+        snprintf(cmd, sizeof(cmd), "./tracegen-syn %s -n %lu -o %s",
+                 TRACES[t].args, accesses, trace);
+        ok = run(cmd);
+    }
+
+    printf("%-8s%12s%12s%12s%14s\n", "Pattern", "( s,   E,b)", "Accesses",
+           "Seconds", "Acc/sec");
+
+    double total_secs = 0.0;
+    unsigned long total_accesses = 0;
+    for (size_t t = 0; t < NTRACES && ok; t++) {
+        snprintf(trace, sizeof(trace), "%s/%s.trace", dir, TRACES[t].name);
+        for (size_t g = 0; g < NGEOMS && ok; g++) {
+            const bench_geom_t *geom = &GEOMS[g];
+            snprintf(cmd, sizeof(cmd), "%s -s %d -E %d -b %d -t %s > /dev/null",
+                     csim, geom->s, geom->E, geom->b, trace);
+
+            double best = 0.0;
+            for (int r = 0; r < reps && ok; r++) {
+                double start = now();
+                ok = run(cmd);
+                double secs = now() - start;
+                if (r == 0 || secs < best) {
+                    best = secs;
+                }
+            }
+            if (!ok) {
+                break;
+            }
+
+            char buf[MAX_STR];
+            sprintf(buf, "(%2d,%4d,%1d)", geom->s, geom->E, geom->b);
+            printf("%-8s%12s%12lu%12.3f%14.0f\n", TRACES[t].name, buf,
+                   accesses, best, (double)accesses / best);
+            total_secs += best;
+            total_accesses += accesses;
+        }
+    }
+
+    (void)remove(".csim_results");
+    for (size_t t = 0; t < NTRACES; t++) {
+        snprintf(trace, sizeof(trace), "%s/%s.trace", dir, TRACES[t].name);
+        (void)remove(trace);
+    }
+    (void)rmdir(dir);
+
+    if (!ok) {
+        exit(1);
+    }
+
+    printf("%-8s%12s%12lu%12.3f%14.0f\n", "total", "", total_accesses,
+           total_secs, (double)total_accesses / total_secs);
+    printf("\nBENCH_CSIM_RESULTS=%.0f\n", (double)total_accesses / total_secs);
+    return 0;
+}
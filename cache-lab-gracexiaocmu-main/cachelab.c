@@ -48,10 +48,24 @@ void printSummary(const csim_stats_t *stats) {
  * @return True if the operation was successful, false otherwise
  */
 bool loadSummary(csim_stats_t *stats) {
+    return loadSummaryFile(".csim_results", stats);
+}
+
+/**
+ * @brief Load a summary of the cache simulation statistics from a file.
+ *
+ * Used when the simulator ran in a different working directory.
+ *
+ * @param[in]  path  The results file written by printSummary()
+ * @param[out] stats The simulation statistics that were read
+ *
+ * @return True if the operation was successful, false otherwise
+ */
+bool loadSummaryFile(const char *path, csim_stats_t *stats) {
     /* Get the results from the simulator */
-    FILE *fp = fopen(".csim_results", "r");
+    FILE *fp = fopen(path, "r");
     if (fp == NULL) {
-        fprintf(stderr, "Failed to open .csim_results: %s\n", strerror(errno));
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
         return false;
     }
 
@@ -67,6 +81,92 @@ bool loadSummary(csim_stats_t *stats) {
     return true;
 }
 
+/**
+ * @brief Parse a timing model specification.
+ *
+ * The spec is a comma-separated list "hit,miss,fill,writeback,mshrs".
+ * Trailing fields may be omitted, and empty fields are left unchanged, so
+ * the caller should initialize the struct with its defaults first.
+ *
+ * @param[in]     spec   The specification string
+ * @param[in,out] timing The parsed timing parameters
+ *
+ * @return True if the spec was well formed, false otherwise
+ */
+bool parseTiming(const char *spec, csim_timing_t *timing) {
+    unsigned long *fields[] = {&timing->hit_cycles, &timing->miss_cycles,
+                               &timing->fill_cycles, &timing->writeback_cycles,
+                               &timing->mshrs};
+    size_t nfields = sizeof(fields) / sizeof(fields[0]);
+    const char *p = spec;
+
+    for (size_t i = 0; i < nfields && *p != '\0'; i++) {
+        if (*p != ',') {
+            char *end;
+            errno = 0;
+            unsigned long val = strtoul(p, &end, 10);
+            if (end == p || errno != 0) {
+                return false;
+            }
+            *fields[i] = val;
+            p = end;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+
+    return *p == '\0' && timing->mshrs > 0;
+}
+
+/**
+ * @brief Store a summary of the timing model results.
+ *
+ * @param[in] stats The timing results to be stored
+ */
+void printTiming(const csim_timing_stats_t *stats) {
+    printf("cycles:%ld stall_cycles:%ld bus_cycles:%ld\n", stats->cycles,
+           stats->stall_cycles, stats->bus_cycles);
+
+    FILE *output_fp = fopen(".csim_timing", "w");
+    if (output_fp == NULL) {
+        fprintf(stderr, "Error: failed to open timing file: %s\n",
+                strerror(errno));
+        return;
+    }
+
+    fprintf(output_fp, "%ld %ld %ld\n", stats->cycles, stats->stall_cycles,
+            stats->bus_cycles);
+    fclose(output_fp);
+}
+
+/**
+ * @brief Load the stored summary of the timing model results.
+ *
+ * @param[out] stats The timing results that were read
+ *
+ * @return True if the operation was successful, false otherwise
+ */
+bool loadTiming(csim_timing_stats_t *stats) {
+    FILE *fp = fopen(".csim_timing", "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open .csim_timing: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (fscanf(fp, "%lu %lu %lu", &stats->cycles, &stats->stall_cycles,
+               &stats->bus_cycles) < 3) {
+        fprintf(stderr, "Error: Timing results not formatted correctly\n");
+        fclose(fp);
+        return false;
+    }
+
+    fclose(fp);
+    return true;
+}
+
 /**
  * @brief Initialize the given matrices
  */
@@ -26,6 +26,43 @@ void printSummary(const csim_stats_t *stats);
 /* @brief Load the stored summary of the cache simulation statistics. */
 bool loadSummary(csim_stats_t *stats);
 
+/* @brief Load a stored summary from the given results file. */
+bool loadSummaryFile(const char *path, csim_stats_t *stats);
+
+/**
+ * @brief Struct representing the parameters of the csim timing model
+ *
+ * The model charges hit_cycles for the cache itself and miss_cycles for a
+ * fill from the next level of the hierarchy. Up to mshrs misses may be
+ * outstanding at once, and all fills and writebacks share one memory bus
+ * that is busy for fill_cycles / writeback_cycles per line.
+ */
+typedef struct {
+    unsigned long hit_cycles;       /* latency of a cache hit */
+    unsigned long miss_cycles;      /* latency of a fill from the next level */
+    unsigned long fill_cycles;      /* bus occupancy of one line fill */
+    unsigned long writeback_cycles; /* bus occupancy of one dirty writeback */
+    unsigned long mshrs;            /* maximum number of outstanding misses */
+} csim_timing_t;
+
+/**
+ * @brief Struct representing the timing model results for a trace
+ */
+typedef struct {
+    unsigned long cycles;       /* estimated total cycles */
+    unsigned long stall_cycles; /* cycles spent waiting on outstanding misses */
+    unsigned long bus_cycles;   /* cycles the memory bus was busy */
+} csim_timing_stats_t;
+
+/** @brief Parse a "hit,miss,fill,writeback,mshrs" timing model spec. */
+bool parseTiming(const char *spec, csim_timing_t *timing);
+
+/** @brief Store a summary of the timing model results. */
+void printTiming(const csim_timing_stats_t *stats);
+
+/** @brief Load the stored summary of the timing model results. */
+bool loadTiming(csim_timing_stats_t *stats);
+
 /* Grading parameters for transpose */
 
 /** @brief Number of clock cycles for hit */
@@ -34,6 +71,21 @@ bool loadSummary(csim_stats_t *stats);
 /** @brief Number of clock cycles for miss */
 #define MISS_CYCLES 100
 
+/** @brief Timing model: number of clock cycles for a hit */
+#define TIMING_HIT_CYCLES HIT_CYCLES
+
+/** @brief Timing model: latency of a fill from memory */
+#define TIMING_MISS_CYCLES MISS_CYCLES
+
+/** @brief Timing model: memory bus cycles to transfer one line */
+#define TIMING_FILL_CYCLES 8
+
+/** @brief Timing model: memory bus cycles to write back one dirty line */
+#define TIMING_WRITEBACK_CYCLES 8
+
+/** @brief Timing model: number of outstanding misses (Haswell L1 has 10) */
+#define TIMING_MSHRS 10
+
 /** @brief Log number of sets */
 #define TEST_LOG_SET 5
 
@@ -59,6 +111,9 @@ bool loadSummary(csim_stats_t *stats);
            student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
+/** @brief The description string for the multi-threaded native transpose */
+#define PARALLEL_DESCRIPTION "Parallel tiled transpose"
+
 /** @brief Maximum value of M or N in transpose functions */
 #define MAXN 4096
 
@@ -84,6 +139,101 @@ extern int func_counter;
 /* External function defined in trans.c */
 extern void registerFunctions(void);
 
+/* External functions defined in trans-native.c */
+extern void registerNativeFunctions(void);
+
+/** @brief Set the thread count of the parallel transpose (0 = per CPU) */
+extern void transSetThreads(int threads);
+
+/** @brief Get the thread count of the parallel transpose */
+extern int transGetThreads(void);
+
+/* External function defined in trace-cache.c */
+
+/** @brief Computes the trace cache key of each registered function */
+extern bool traceCacheKeys(const char *obj_path, const char *const deps[],
+                           size_t M, size_t N,
+                           unsigned long long keys[MAX_TRANS_FUNCS]);
+
+/** @brief Order in which transTiled() visits the tiles of A */
+typedef enum {
+    TILE_ROW_MAJOR, /* all tiles of a band of rows, then the next band */
+    TILE_COL_MAJOR  /* all tiles of a band of columns, then the next band */
+} tile_order_t;
+
+/** @brief How transTiled() avoids conflicts between A and B on the diagonal */
+typedef enum {
+    DIAG_DIRECT,   /* no special handling */
+    DIAG_DEFER,    /* keep each diagonal element in tmp until its row is done */
+    DIAG_STAGE,    /* copy rows of diagonal tiles through tmp */
+    DIAG_STAGE_ALL /* copy rows of every tile through tmp */
+} diag_mode_t;
+
+/**
+ * @brief Struct representing one tiling strategy for transTiled()
+ */
+typedef struct {
+    size_t tile_rows;   /* rows of A per tile */
+    size_t tile_cols;   /* columns of A per tile */
+    tile_order_t order; /* tile traversal order */
+    diag_mode_t diag;   /* diagonal handling */
+    size_t stage_rows;  /* rows of a tile staged in tmp at once */
+} trans_params_t;
+
+/** @brief Tiled transpose parameterized by a tiling strategy */
+extern void transTiled(size_t M, size_t N, double A[N][M], double B[M][N],
+                       double *tmp, const trans_params_t *params);
+
+/** @brief Cache-oblivious recursive transpose with the given leaf size */
+extern void transRecursive(size_t M, size_t N, double A[N][M], double B[M][N],
+                           double *tmp, size_t leaf);
+
+/** @brief Transposes the square matrix A in place, using tmp as scratch */
+extern void transInPlace(size_t N, double A[N][N], double *tmp);
+
+/** @brief Transposes K matrices of N x M stored back to back in A */
+extern void transBatch(size_t K, size_t M, size_t N, double A[K][N][M],
+                       double B[K][M][N], double *tmp);
+
+/** @brief Element types of the generic kernels in trans-elem.c */
+typedef enum {
+    ELEM_DOUBLE,
+    ELEM_FLOAT,
+    ELEM_INT32,
+    ELEM_INT64,
+    ELEM_CDOUBLE, /* double complex */
+    ELEM_NTYPES
+} elem_type_t;
+
+/**
+ * @brief Struct representing the kernels generated for one element type
+ *
+ * A is N rows of M elements and B is M rows of N elements.
+ */
+typedef struct {
+    const char *name; /* name of the type, as accepted by -e */
+    size_t size;      /* size of one element in bytes */
+    size_t tile;      /* tile edge, the number of elements per cache line */
+    void (*trans)(size_t M, size_t N, const void *A, void *B);
+    void (*correct)(size_t M, size_t N, const void *A, void *B);
+    void (*init)(size_t M, size_t N, void *A);
+} elem_kernels_t;
+
+/* External functions and variables defined in trans-elem.c */
+extern const elem_kernels_t elemKernels[ELEM_NTYPES];
+
+/** @brief Looks up the kernels for an element type by name, or NULL */
+extern const elem_kernels_t *findElemKernels(const char *name);
+
+/**
+ * @brief Called before every access by the hooked kernels in trans.c.
+ *
+ * Only used when trans.c (or trans-elem.c) is compiled with TRANS_HOOKS, in
+ * which case the program linking it (e.g. trans-tune) must define this
+ * function.
+ */
+void transHookAccess(char op, const void *addr);
+
 /** @brief Fills a matrix with data */
 void initMatrix(size_t M, size_t N, double A[N][M], double B[M][N]);
 
@@ -5,6 +5,7 @@
 #include "cachelab.h"
 #include <getopt.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,19 +14,45 @@
 #define MAX_LINE_LENGTH 80
 
 /**
- * Global variables for number of dirty bytes in cache and
- * number of dirty bytes evicted, can be used and modified
- * by all functions
+ * Default number of accesses between two checkpoints
  */
-unsigned int dirty_in_cache = 0;
-unsigned int dirty_evicted = 0;
+#define CHECKPOINT_INTERVAL 10000000UL
+
+/**
+ * Magic number at the start of every snapshot file
+ */
+#define SNAPSHOT_MAGIC "CSIMSNP2"
+
+/**
+ * Number of 64-bit header fields after the magic number
+ */
+#define SNAPSHOT_HEADER 14
+
+/**
+ * Global variables for number of dirty sectors in cache and
+ * number of dirty sectors evicted, can be used and modified
+ * by all functions. Without -S a sector is a whole line.
+ */
+unsigned long dirty_in_cache = 0;
+unsigned long dirty_evicted = 0;
+
+/**
+ * Global variables for the sectored cache statistics: accesses that hit
+ * the tag but missed a sector, sectors fetched from the next level, and
+ * lines with any dirty sector that were evicted
+ */
+unsigned long sector_misses = 0;
+unsigned long sectors_filled = 0;
+unsigned long dirty_lines_evicted = 0;
 
 /**
  * Linked list element representing a line in cache
  */
 typedef struct list_ele {
-    int dirty;
+    uint64_t valid; // bit mask of sectors present in the line
+    uint64_t dirty; // bit mask of dirty sectors
     long tag;
+    unsigned long ready; // cycle at which the line's fill completes
     struct list_ele *next;
 } list_ele_t;
 
@@ -52,6 +79,31 @@ queue_t *queue_new(void) {
     return q;
 }
 
+/**
+ * Append a line at the most recently used end of the queue
+ * Return the new line, or NULL if out of memory
+ */
+list_ele_t *queue_append(queue_t *q, long tag, uint64_t valid,
+                         uint64_t dirty) {
+    list_ele_t *newt = malloc(sizeof(list_ele_t));
+    if (newt == NULL) {
+        return NULL;
+    }
+    newt->tag = tag;
+    newt->valid = valid;
+    newt->dirty = dirty;
+    newt->ready = 0;
+    newt->next = NULL;
+    if (q->head == NULL) {
+        q->head = newt;
+    } else {
+        q->tail->next = newt;
+    }
+    q->tail = newt;
+    q->size++;
+    return newt;
+}
+
 /**
  * Free the queue (ie a set in cache)
  */
@@ -81,25 +133,56 @@ void cache_free(queue_t **c, int s) {
     }
 }
 
+/**
+ * Number of sectors set in a sector mask
+ */
+unsigned long count_sectors(uint64_t mask) {
+    return (unsigned long)__builtin_popcountll(mask);
+}
+
+/**
+ * Mask of the sectors of its line touched by an access of size bytes
+ * Accesses that cross the end of the line are clipped to it
+ */
+uint64_t sector_mask(long address, unsigned long size, int block,
+                     int sector_bits) {
+    unsigned long line_bytes = 1UL << block;
+    unsigned long first = (unsigned long)address & (line_bytes - 1);
+    unsigned long last = first + (size > 0 ? size - 1 : 0);
+    if (last >= line_bytes) {
+        last = line_bytes - 1;
+    }
+    first >>= sector_bits;
+    last >>= sector_bits;
+    unsigned long n = last - first + 1;
+    uint64_t bits = n >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+    return bits << first;
+}
+
 /**
  * Simulate the operation in cache of one line in the trace file
- * Return hit('h'), miss('m'), or miss eviction('e')
- * Change global variables to keep track of dirty bits
+ * Return hit('h'), sector miss('s'), miss('m'), or miss eviction('e')
+ * A sector miss hits the tag but fetches some of the touched sectors.
+ * Change global variables to keep track of dirty and filled sectors
+ * Set *line to the cache line that now holds the address
  */
 char cache_insert(queue_t *qset, long address, int entry, int set, int block,
-                  char *op) {
+                  char *op, uint64_t touched, list_ele_t **line) {
     long tag = address >> (set + block);
+    int store = (strcmp(op, "S") == 0);
 
     // Check if there's a hit
     list_ele_t *temp = qset->head;
     list_ele_t *prev = NULL;
     while (temp != NULL) {
         if (temp->tag == tag) { // hit
-            if (strcmp(op, "S") == 0) {
-                if (temp->dirty == 0) {
-                    dirty_in_cache++;
-                }
-                temp->dirty = 1;
+            *line = temp;
+            uint64_t need = touched & ~temp->valid;
+            sectors_filled += count_sectors(need);
+            temp->valid |= touched;
+            if (store) {
+                dirty_in_cache += count_sectors(touched & ~temp->dirty);
+                temp->dirty |= touched;
             }
             if ((temp != qset->tail) && (temp == qset->head)) {
                 qset->head = temp->next;
@@ -112,13 +195,16 @@ char cache_insert(queue_t *qset, long address, int entry, int set, int block,
                 qset->tail = temp;
                 temp->next = NULL;
             }
-            return 'h';
+            return need != 0 ? 's' : 'h';
         }
         prev = temp;
         temp = temp->next;
     }
 
-    // It's a miss, and we need to decide if there's an eviction
+    // It's a miss, only the touched sectors are fetched
+    sectors_filled += count_sectors(touched);
+
+    // Decide if there's an eviction
     if (qset->size == entry) { // eviction
         temp = qset->head;
         qset->tail->next = temp;
@@ -128,49 +214,358 @@ char cache_insert(queue_t *qset, long address, int entry, int set, int block,
         qset->tail = temp;
         temp->next = NULL;
         temp->tag = tag;
-        if (strcmp(op, "S") == 0) {
-            if (temp->dirty == 1) {
-                dirty_evicted++;
-            } else {
-                dirty_in_cache++;
-            }
-            temp->dirty = 1;
-        } else { // load
-            if (temp->dirty == 1) {
-                dirty_evicted++;
-                dirty_in_cache--;
-            }
-            temp->dirty = 0;
+        *line = temp;
+        if (temp->dirty != 0) {
+            dirty_evicted += count_sectors(temp->dirty);
+            dirty_in_cache -= count_sectors(temp->dirty);
+            dirty_lines_evicted++;
         }
+        temp->valid = touched;
+        temp->dirty = store ? touched : 0;
+        dirty_in_cache += count_sectors(temp->dirty);
         return 'e';
     } else { // Miss but no eviction, create a new list node
-        list_ele_t *newt;
         if (qset == NULL) {
             return 'f';
         }
-        newt = malloc(sizeof(list_ele_t));
+        list_ele_t *newt = queue_append(qset, tag, touched, 0);
         if (newt == NULL) {
             return 'f';
         }
-        newt->tag = tag;
-        newt->next = NULL;
-        newt->dirty = 0;
-        if (qset->head == NULL) {
-            qset->head = newt;
-        } else {
-            qset->tail->next = newt;
-        }
-        qset->size++;
-        qset->tail = newt;
-        if (strcmp(op, "S") == 0) {
-            newt->dirty = 1;
-            dirty_in_cache++;
+        *line = newt;
+        if (store) {
+            newt->dirty = touched;
+            dirty_in_cache += count_sectors(touched);
         }
         return 'm';
     }
     return 'f';
 }
 
+/**
+ * State of the timing model: the cycle at which the next access issues,
+ * the completion cycle of each miss status holding register (MSHR) and
+ * the cycle at which the memory bus becomes free
+ */
+typedef struct {
+    csim_timing_t params;
+    unsigned long sectors; // sectors per line, bus costs are per full line
+    unsigned long now;
+    unsigned long bus_free;
+    unsigned long *mshr;
+    csim_timing_stats_t stats;
+} timing_t;
+
+/**
+ * Initialize the timing model with the given parameters
+ * Return 0 on success, -1 if out of memory
+ */
+int timing_init(timing_t *t, const csim_timing_t *params,
+                unsigned long sectors) {
+    t->params = *params;
+    t->sectors = sectors;
+    t->now = 0;
+    t->bus_free = 0;
+    t->mshr = calloc(params->mshrs, sizeof(unsigned long));
+    t->stats.cycles = 0;
+    t->stats.stall_cycles = 0;
+    t->stats.bus_cycles = 0;
+    return t->mshr == NULL ? -1 : 0;
+}
+
+/**
+ * Stall the timing model until the given cycle
+ */
+void timing_stall(timing_t *t, unsigned long until) {
+    if (until > t->now) {
+        t->stats.stall_cycles += until - t->now;
+        t->now = until;
+    }
+}
+
+/**
+ * Bus cycles to move the given number of sectors of a line
+ */
+unsigned long timing_bus(const timing_t *t, unsigned long line_cycles,
+                         unsigned long sectors) {
+    return (line_cycles * sectors + t->sectors - 1) / t->sectors;
+}
+
+/**
+ * Charge the cost of one access given its result from cache_insert
+ * A hit to a line whose fill is still in flight waits for the fill.
+ * A miss takes the MSHR that frees up first, stalling if all are busy,
+ * then queues its fill (and the writeback of a dirty victim) on the bus.
+ * Independent misses therefore overlap up to the number of MSHRs.
+ * Fills and writebacks occupy the bus in proportion to the sectors moved.
+ */
+void timing_access(timing_t *t, char result, list_ele_t *line,
+                   unsigned long fill_sectors, unsigned long wb_sectors) {
+    const csim_timing_t *p = &t->params;
+
+    if (result == 'h') {
+        timing_stall(t, line->ready);
+        t->now += p->hit_cycles;
+        return;
+    }
+
+    unsigned long slot = 0;
+    for (unsigned long i = 1; i < p->mshrs; i++) {
+        if (t->mshr[i] < t->mshr[slot]) {
+            slot = i;
+        }
+    }
+    timing_stall(t, t->mshr[slot]);
+
+    // The tag check costs a hit before the request leaves the cache
+    unsigned long start = t->now + p->hit_cycles;
+    if (t->bus_free > start) {
+        start = t->bus_free;
+    }
+    unsigned long busy = timing_bus(t, p->fill_cycles, fill_sectors) +
+                         timing_bus(t, p->writeback_cycles, wb_sectors);
+    t->bus_free = start + busy;
+    t->stats.bus_cycles += busy;
+
+    line->ready = start + p->miss_cycles;
+    t->mshr[slot] = line->ready;
+    t->now += p->hit_cycles;
+}
+
+/**
+ * Drain all outstanding misses and record the total cycle count
+ */
+void timing_finish(timing_t *t) {
+    unsigned long end = t->now;
+    for (unsigned long i = 0; i < t->params.mshrs; i++) {
+        if (t->mshr[i] > end) {
+            end = t->mshr[i];
+        }
+    }
+    t->stats.cycles = end;
+}
+
+/**
+ * Geometry of the simulated cache
+ */
+typedef struct {
+    int set;         // log2 of the number of sets
+    int entry;       // lines per set
+    int block;       // log2 of the line size
+    int sector_bits; // log2 of the sector size
+} geom_t;
+
+/**
+ * Counters accumulated over the trace
+ */
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long accesses;
+} counters_t;
+
+/**
+ * Write one 64-bit field of a snapshot
+ * Return 0 on success, -1 on a write error
+ */
+int snap_put(FILE *fp, uint64_t val) {
+    return fwrite(&val, sizeof(val), 1, fp) == 1 ? 0 : -1;
+}
+
+/**
+ * Read one 64-bit field of a snapshot
+ * Return 0 on success, -1 on a read error or truncated file
+ */
+int snap_get(FILE *fp, uint64_t *val) {
+    return fread(val, sizeof(*val), 1, fp) == 1 ? 0 : -1;
+}
+
+/**
+ * Save the full simulator state into a binary snapshot
+ *
+ * The snapshot holds the magic number, the cache geometry, the counters,
+ * the byte offset of the next trace line, the timing model state (if
+ * any), then for every set its lines from least to most recently used,
+ * each with its tag and valid and dirty sector masks.
+ * All fields are 64-bit words in host byte order; the ready cycle of a
+ * line is only stored when the timing model is on.
+ * The snapshot is written to a temporary file and renamed into place, so
+ * a crash while checkpointing leaves the previous snapshot intact.
+ * Return 0 on success, -1 on failure
+ */
+int snapshot_save(const char *path, queue_t **cache, unsigned long nsets,
+                  const geom_t *g, const counters_t *cnt, long offset,
+                  const timing_t *t) {
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    int err = fwrite(SNAPSHOT_MAGIC, 8, 1, fp) == 1 ? 0 : -1;
+    uint64_t header[SNAPSHOT_HEADER] = {(uint64_t)g->set,
+                                        (uint64_t)g->entry,
+                                        (uint64_t)g->block,
+                                        (uint64_t)g->sector_bits,
+                                        cnt->hits,
+                                        cnt->misses,
+                                        cnt->evictions,
+                                        cnt->accesses,
+                                        dirty_evicted,
+                                        sector_misses,
+                                        sectors_filled,
+                                        dirty_lines_evicted,
+                                        (uint64_t)offset,
+                                        t != NULL ? t->params.mshrs : 0};
+    for (size_t i = 0; i < SNAPSHOT_HEADER; i++) {
+        err |= snap_put(fp, header[i]);
+    }
+    if (t != NULL) {
+        err |= snap_put(fp, t->now);
+        err |= snap_put(fp, t->bus_free);
+        err |= snap_put(fp, t->stats.stall_cycles);
+        err |= snap_put(fp, t->stats.bus_cycles);
+        for (unsigned long i = 0; i < t->params.mshrs; i++) {
+            err |= snap_put(fp, t->mshr[i]);
+        }
+    }
+
+    for (unsigned long i = 0; i < nsets; i++) {
+        err |= snap_put(fp, (uint64_t)cache[i]->size);
+        for (list_ele_t *e = cache[i]->head; e != NULL; e = e->next) {
+            err |= snap_put(fp, (uint64_t)e->tag);
+            err |= snap_put(fp, e->valid);
+            err |= snap_put(fp, e->dirty);
+            if (t != NULL) {
+                err |= snap_put(fp, e->ready);
+            }
+        }
+    }
+
+    if (fclose(fp) != 0 || err != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return rename(tmp_path, path) == 0 ? 0 : -1;
+}
+
+/**
+ * Load a snapshot written by snapshot_save into an empty cache
+ *
+ * The geometry must match the current run. If warm is set, only the
+ * cache contents are restored: the counters, trace offset and timing
+ * state start from zero so that several experiments can branch from
+ * the same warmed cache. Otherwise the whole state is restored and
+ * *offset is set to where the trace should resume.
+ * Return 0 on success, -1 on failure
+ */
+int snapshot_load(const char *path, queue_t **cache, unsigned long nsets,
+                  const geom_t *g, counters_t *cnt, long *offset, timing_t *t,
+                  int warm) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("snapshot doesn't exist\n");
+        return -1;
+    }
+
+    char magic[8];
+    uint64_t header[SNAPSHOT_HEADER];
+    int err = fread(magic, 8, 1, fp) == 1 ? 0 : -1;
+    err |= memcmp(magic, SNAPSHOT_MAGIC, 8) == 0 ? 0 : -1;
+    for (size_t i = 0; i < SNAPSHOT_HEADER && err == 0; i++) {
+        err |= snap_get(fp, &header[i]);
+    }
+    if (err != 0) {
+        printf("not a csim snapshot\n");
+        fclose(fp);
+        return -1;
+    }
+    if (header[0] != (uint64_t)g->set || header[1] != (uint64_t)g->entry ||
+        header[2] != (uint64_t)g->block ||
+        header[3] != (uint64_t)g->sector_bits) {
+        printf("snapshot geometry (s=%lu, E=%lu, b=%lu, sector=%lu) doesn't "
+               "match\n",
+               (unsigned long)header[0], (unsigned long)header[1],
+               (unsigned long)header[2], 1UL << header[3]);
+        fclose(fp);
+        return -1;
+    }
+
+    uint64_t mshrs = header[13];
+    if (!warm && t != NULL && mshrs != t->params.mshrs) {
+        printf("snapshot has no timing state for %lu MSHRs\n", t->params.mshrs);
+        fclose(fp);
+        return -1;
+    }
+    if (!warm) {
+        cnt->hits = header[4];
+        cnt->misses = header[5];
+        cnt->evictions = header[6];
+        cnt->accesses = header[7];
+        dirty_evicted = header[8];
+        sector_misses = header[9];
+        sectors_filled = header[10];
+        dirty_lines_evicted = header[11];
+        *offset = (long)header[12];
+    }
+
+    // The timing state is restored when resuming with the timing model on,
+    // and skipped otherwise
+    uint64_t val = 0;
+    for (uint64_t i = 0; mshrs != 0 && i < 4 + mshrs; i++) {
+        err |= snap_get(fp, &val);
+        if (warm || t == NULL) {
+            continue;
+        }
+        if (i == 0) {
+            t->now = val;
+        } else if (i == 1) {
+            t->bus_free = val;
+        } else if (i == 2) {
+            t->stats.stall_cycles = val;
+        } else if (i == 3) {
+            t->stats.bus_cycles = val;
+        } else {
+            t->mshr[i - 4] = val;
+        }
+    }
+
+    dirty_in_cache = 0;
+    for (unsigned long i = 0; i < nsets && err == 0; i++) {
+        uint64_t size, tag, valid, dirty, ready = 0;
+        err |= snap_get(fp, &size);
+        if (size > (uint64_t)g->entry) {
+            err = -1;
+        }
+        for (uint64_t k = 0; k < size && err == 0; k++) {
+            err |= snap_get(fp, &tag);
+            err |= snap_get(fp, &valid);
+            err |= snap_get(fp, &dirty);
+            if (mshrs != 0) {
+                err |= snap_get(fp, &ready);
+            }
+            list_ele_t *e = queue_append(cache[i], (long)tag, valid, dirty);
+            if (e == NULL) {
+                err = -1;
+                break;
+            }
+            if (!warm && t != NULL) {
+                e->ready = ready;
+            }
+            dirty_in_cache += count_sectors(dirty);
+        }
+    }
+
+    fclose(fp);
+    if (err != 0) {
+        printf("snapshot is truncated or corrupt\n");
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * Main function that reads command line and simulates cache
  * operations with the given trace file.
@@ -182,13 +577,23 @@ int main(int argc, char *argv[]) {
     entry = 0;
     block = 0;
     char *text = NULL;
-    unsigned int hits, misses, evictions;
-    hits = 0;
-    misses = 0;
-    evictions = 0;
+    counters_t cnt = {0, 0, 0, 0};
+    char *checkpoint = NULL;
+    char *resume = NULL;
+    int warm = 0;
+    unsigned long interval = CHECKPOINT_INTERVAL;
+    unsigned long sectors = 1;
+    int use_timing = 0;
+    csim_timing_t timing_params = {
+        .hit_cycles = TIMING_HIT_CYCLES,
+        .miss_cycles = TIMING_MISS_CYCLES,
+        .fill_cycles = TIMING_FILL_CYCLES,
+        .writeback_cycles = TIMING_WRITEBACK_CYCLES,
+        .mshrs = TIMING_MSHRS,
+    };
 
     // Read command line flags and arguments
-    while ((opt = getopt(argc, argv, "s:E:b:t:")) != -1) {
+    while ((opt = getopt(argc, argv, "s:E:b:t:T:c:i:r:w:S:")) != -1) {
         switch (opt) {
         case 's':
             set = atoi(optarg);
@@ -206,6 +611,32 @@ int main(int argc, char *argv[]) {
             text = optarg;
             printf("file:%s\n", text);
             break;
+        case 'T':
+            if (!parseTiming(optarg, &timing_params)) {
+                printf("Bad timing spec, expected hit,miss,fill,wb,mshrs\n");
+                exit(EXIT_FAILURE);
+            }
+            use_timing = 1;
+            break;
+        case 'c':
+            checkpoint = optarg;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 10);
+            if (interval == 0) {
+                printf("Checkpoint interval must be positive\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+        case 'w':
+            resume = optarg;
+            warm = (opt == 'w');
+            break;
+        case 'S':
+            sectors = strtoul(optarg, NULL, 10);
+            printf("sectors:%lu\n", sectors);
+            break;
         default:
             printf("Wrong flag or missing argument.\n");
             exit(EXIT_FAILURE);
@@ -217,6 +648,18 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    // Sectors split the line evenly, and each line tracks them in a mask
+    int sector_log = 0;
+    while ((1UL << sector_log) < sectors) {
+        sector_log++;
+    }
+    if (sectors == 0 || sectors > 64 || (1UL << sector_log) != sectors ||
+        sector_log > block) {
+        printf("Sectors must be a power of two, at most 64 and 2^b\n");
+        exit(EXIT_FAILURE);
+    }
+    geom_t geom = {set, entry, block, block - sector_log};
+
     FILE *fptr;
 
     fptr = fopen(text, "r");
@@ -238,31 +681,79 @@ int main(int argc, char *argv[]) {
         cache[i] = queue_new();
     }
 
+    timing_t timing;
+    if (use_timing && timing_init(&timing, &timing_params, sectors) < 0) {
+        printf("fail to initialize timing model\n");
+        exit(EXIT_FAILURE);
+    }
+    timing_t *tp = use_timing ? &timing : NULL;
+
+    // Restore a previous run, or warm the cache from a snapshot
+    long offset = 0;
+    if (resume != NULL) {
+        if (snapshot_load(resume, cache, cache_size, &geom, &cnt, &offset, tp,
+                          warm) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        if (fseek(fptr, offset, SEEK_SET) != 0) {
+            printf("fail to seek to trace offset %ld\n", offset);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // Iterate through each line and simulate the cache operations
     while (fgets(line, MAX_LINE_LENGTH, fptr)) {
         char *op = strtok(line, " ");
         char *nums = strtok(NULL, " ");
         char *addr = strtok(nums, ",");
-        // char *bsize = strtok(NULL, ",");
+        char *bsize = strtok(NULL, ",");
         long address = (long)strtol(addr, NULL, 16);
+        unsigned long size = bsize != NULL ? strtoul(bsize, NULL, 10) : 1;
         int set_number = (address >> block) & (int)(pow(2, (set)) - 1);
-        char result =
-            cache_insert(cache[set_number], address, entry, set, block, op);
+        uint64_t touched = sector_mask(address, size, block, geom.sector_bits);
+        unsigned long evicted_before = dirty_evicted;
+        unsigned long filled_before = sectors_filled;
+        list_ele_t *cline = NULL;
+        char result = cache_insert(cache[set_number], address, entry, set,
+                                   block, op, touched, &cline);
+        if (use_timing && cline != NULL) {
+            timing_access(&timing, result, cline,
+                          sectors_filled - filled_before,
+                          dirty_evicted - evicted_before);
+        }
         switch (result) {
         case 'h':
-            hits++;
+            cnt.hits++;
+            break;
+        case 's':
+            sector_misses++;
+            cnt.misses++;
             break;
         case 'm':
-            misses++;
+            cnt.misses++;
             break;
         case 'e':
-            evictions++;
-            misses++;
+            cnt.evictions++;
+            cnt.misses++;
             break;
         default:
             printf("fail to insert cache\n");
             exit(EXIT_FAILURE);
         }
+
+        cnt.accesses++;
+        if (checkpoint != NULL && cnt.accesses % interval == 0 &&
+            snapshot_save(checkpoint, cache, cache_size, &geom, &cnt,
+                          ftell(fptr), tp) < 0) {
+            printf("fail to write checkpoint %s\n", checkpoint);
+        }
+    }
+
+    // A final snapshot lets later runs branch from the warmed cache
+    if (checkpoint != NULL &&
+        snapshot_save(checkpoint, cache, cache_size, &geom, &cnt, ftell(fptr),
+                      tp) < 0) {
+        printf("fail to write checkpoint %s\n", checkpoint);
     }
 
     // Create a csim_stats_t variable and pass in the results
@@ -272,13 +763,31 @@ int main(int argc, char *argv[]) {
         printf("null stat struct\n");
         exit(EXIT_FAILURE);
     }
-    stat->dirty_bytes = dirty_in_cache * (unsigned int)pow(2, block);
-    stat->dirty_evictions = dirty_evicted * (unsigned int)pow(2, block);
-    stat->evictions = evictions;
-    stat->hits = hits;
-    stat->misses = misses;
+    unsigned long line_bytes = 1UL << block;
+    unsigned long sector_bytes = 1UL << geom.sector_bits;
+    stat->dirty_bytes = dirty_in_cache * sector_bytes;
+    stat->dirty_evictions = dirty_evicted * sector_bytes;
+    stat->evictions = cnt.evictions;
+    stat->hits = cnt.hits;
+    stat->misses = cnt.misses;
     printSummary(stat);
 
+    // Compare the traffic of the sectored cache to full-line fills
+    if (sectors > 1) {
+        unsigned long line_misses = cnt.misses - sector_misses;
+        printf("sector_misses:%lu bytes_filled:%lu bytes_written_back:%lu "
+               "full_line_bytes:%lu\n",
+               sector_misses, sectors_filled * sector_bytes,
+               dirty_evicted * sector_bytes,
+               (line_misses + dirty_lines_evicted) * line_bytes);
+    }
+
+    if (use_timing) {
+        timing_finish(&timing);
+        printTiming(&timing.stats);
+        free(timing.mshr);
+    }
+
     // Free memory and close file
     fclose(fptr);
     free(line);
@@ -7,7 +7,10 @@
  * instructors (csim-ref).
  */
 
+#define _XOPEN_SOURCE 700 // mkdtemp
+
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <signal.h>
@@ -26,6 +29,9 @@
 /** @brief Number of tests */
 #define N 11
 
+/** @brief Seconds before a simulation run is given up on */
+#define JOB_TIMEOUT 20
+
 /** @brief Directory where all traces are located */
 #define TRACES_DIR "traces/csim/"
 
@@ -62,9 +68,10 @@ static int num_runs = 0; // used to randomize input to students' csim
  * usage - Prints usage info
  */
 static void usage(char *argv[]) {
-    printf("Usage: %s [-h]\n", argv[0]);
+    printf("Usage: %s [-hj]\n", argv[0]);
     printf("Options:\n");
     printf("  -h    Print this help message.\n");
+    printf("  -j    Batch mode: run all simulations concurrently.\n");
 }
 
 /**
@@ -120,6 +127,67 @@ static bool run_csim(const char *cmd, csim_stats_t *stats) {
     return success;
 }
 
+/** @brief Number of arguments to a simulator, including the program name */
+#define CSIM_ARGC 9
+
+/**
+ * @brief Builds the arguments for one simulator run.
+ *
+ * @param[in]  info  Information about the trace to run
+ * @param[in]  ref   True for the reference simulator, false for csim
+ * @param[in]  run   Run number, used to permute the arguments to csim
+ * @param[in]  root  Directory containing the simulators and traces
+ * @param[out] args  The arguments, starting with the program name
+ */
+static void format_args(const trace_info_t *info, bool ref, int run,
+                        const char *root, char args[CSIM_ARGC][MAX_STR]) {
+    char s[MAX_STR], E[MAX_STR], b[MAX_STR], t[MAX_STR];
+    sprintf(s, "%d", info->s);
+    sprintf(E, "%d", info->E);
+    sprintf(b, "%d", info->b);
+    if (root == NULL) {
+        sprintf(t, "%s", info->filename);
+    } else {
+        snprintf(t, sizeof(t), "%s/%s", root, info->filename);
+    }
+
+    /* Reference order, also used for case 3 of the test simulator */
+    const char *opts[4] = {"-s", "-E", "-b", "-t"};
+    const char *vals[4] = {s, E, b, t};
+
+    /* addition 9/28/2017 F17: randomize input to csim to test
+     * that students don't hardcode argument parsing */
+    static const int orders[4][4] = {
+        {2, 0, 3, 1}, /* -b -s -t -E */
+        {3, 1, 0, 2}, /* -t -E -s -b */
+        {1, 2, 3, 0}, /* -E -b -t -s */
+        {0, 1, 2, 3}, /* -s -E -b -t */
+    };
+    const int *order = orders[ref ? 3 : run % 4];
+
+    snprintf(args[0], MAX_STR, "%s/%s", root == NULL ? "." : root,
+             ref ? "csim-ref" : "csim");
+    for (int i = 0; i < 4; i++) {
+        sprintf(args[1 + 2 * i], "%s", opts[order[i]]);
+        sprintf(args[2 + 2 * i], "%s", vals[order[i]]);
+    }
+}
+
+/**
+ * @brief Builds the shell command for one simulator run.
+ */
+static void format_cmd(const trace_info_t *info, bool ref, int run,
+                       char cmd[MAX_STR]) {
+    char args[CSIM_ARGC][MAX_STR];
+    format_args(info, ref, run, NULL, args);
+
+    size_t len = 0;
+    for (int i = 0; i < CSIM_ARGC; i++) {
+        len += (size_t)snprintf(cmd + len, MAX_STR - len, "%s ", args[i]);
+    }
+    snprintf(cmd + len, MAX_STR - len, "> /dev/null");
+}
+
 /*
  * @brief Collects run results for a particular trace
  *
@@ -137,8 +205,7 @@ static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
     char cmd[MAX_STR];
 
     /* Run the reference simulator */
-    sprintf(cmd, "./csim-ref -s %d -E %d -b %d -t %s > /dev/null", info->s,
-            info->E, info->b, info->filename);
+    format_cmd(info, true, 0, cmd);
     if (!run_csim(cmd, ref_stats)) {
         fprintf(stderr, "Running reference simulator failed: '%s'\n", cmd);
         fprintf(stderr, "\n");
@@ -146,26 +213,7 @@ static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
     }
 
     /* Run the test simulator */
-    /* addition 9/28/2017 F17: randomize input to csim to test
-     * that students don't hardcode argument parsing */
-    switch (num_runs % 4) {
-    case 0:
-        sprintf(cmd, "./csim -b %d -s %d -t %s -E %d > /dev/null", info->b,
-                info->s, info->filename, info->E);
-        break;
-    case 1:
-        sprintf(cmd, "./csim -t %s -E %d -s %d -b %d > /dev/null",
-                info->filename, info->E, info->s, info->b);
-        break;
-    case 2:
-        sprintf(cmd, "./csim -E %d -b %d -t %s -s %d > /dev/null", info->E,
-                info->b, info->filename, info->s);
-        break;
-    case 3:
-        sprintf(cmd, "./csim -s %d -E %d -b %d -t %s > /dev/null", info->s,
-                info->E, info->b, info->filename);
-        break;
-    }
+    format_cmd(info, false, num_runs, cmd);
 
     num_runs = num_runs + 1;
 
@@ -178,6 +226,195 @@ static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
     return true;
 }
 
+/**
+ * @brief Struct representing one simulator run in batch mode
+ *
+ * Each job runs in a private working directory, so that concurrent
+ * simulators do not overwrite each other's .csim_results file.
+ */
+typedef struct {
+    const trace_info_t *info; /* trace and cache parameters */
+    bool ref;                 /* reference or test simulator */
+    int run;                  /* run number for argument permutation */
+    csim_stats_t *stats;      /* where to store the results */
+    char dir[MAX_STR];        /* private working directory */
+    pid_t pid;                /* simulator process, or 0 if not running */
+    int status;               /* wait status of the simulator */
+    bool ok;                  /* whether the results were collected */
+} job_t;
+
+/**
+ * @brief Starts one batch job in its own process.
+ *
+ * The simulator is executed directly (not through a shell) so that its
+ * own SIGALRM timeout applies to the simulator itself.
+ *
+ * @return false if the job could not be started, true if OK.
+ */
+static bool start_job(job_t *job, const char *root) {
+    char args[CSIM_ARGC][MAX_STR];
+    char *argv[CSIM_ARGC + 1];
+
+    format_args(job->info, job->ref, job->run, root, args);
+    for (int i = 0; i < CSIM_ARGC; i++) {
+        argv[i] = args[i];
+    }
+    argv[CSIM_ARGC] = NULL;
+
+    snprintf(job->dir, sizeof(job->dir), "/tmp/test-csim.XXXXXX");
+    if (mkdtemp(job->dir) == NULL) {
+        fprintf(stderr, "Error creating job directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    job->pid = fork();
+    if (job->pid < 0) {
+        fprintf(stderr, "Error forking simulator: %s\n", strerror(errno));
+        job->pid = 0;
+        return false;
+    }
+
+    if (job->pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0 ||
+            chdir(job->dir) < 0) {
+            _exit(126);
+        }
+        alarm(JOB_TIMEOUT);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Collects the results of a finished batch job and cleans up.
+ */
+static void finish_job(job_t *job) {
+    char path[2 * MAX_STR];
+    snprintf(path, sizeof(path), "%s/.csim_results", job->dir);
+
+    job->pid = 0;
+    if (WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0) {
+        job->ok = loadSummaryFile(path, job->stats);
+    }
+
+    (void)unlink(path);
+    snprintf(path, sizeof(path), "%s/.csim_timing", job->dir);
+    (void)unlink(path);
+    (void)rmdir(job->dir);
+}
+
+/**
+ * @brief Runs the simulations for every trace concurrently.
+ *
+ * Jobs are dispatched to at most one process per online core, and each
+ * simulator gets its own JOB_TIMEOUT. Results are stored by trace index,
+ * so the report does not depend on the order in which jobs finish.
+ *
+ * @param[out] ref_stats   Statistics for the reference simulator
+ * @param[out] test_stats  Statistics for the simulator being tested
+ * @param[out] success     Whether both simulators succeeded on each trace
+ */
+static void run_batch(csim_stats_t ref_stats[N], csim_stats_t test_stats[N],
+                      bool success[N]) {
+    job_t jobs[2 * N];
+    char root[MAX_STR];
+
+    for (int i = 0; i < N; i++) {
+        success[i] = false;
+    }
+
+    if (getcwd(root, sizeof(root)) == NULL) {
+        fprintf(stderr, "Error getting working directory: %s\n",
+                strerror(errno));
+        return;
+    }
+
+    for (int i = 0; i < N; i++) {
+        for (int k = 0; k < 2; k++) {
+            job_t *job = &jobs[2 * i + k];
+            job->info = &TRACE_INFO[i];
+            job->ref = (k == 0);
+            job->run = i;
+            job->stats = job->ref ? &ref_stats[i] : &test_stats[i];
+            job->pid = 0;
+            job->status = -1;
+            job->ok = false;
+        }
+    }
+
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    int next = 0;
+    long running = 0;
+    while (next < 2 * N || running > 0) {
+        while (next < 2 * N && running < workers) {
+            if (start_job(&jobs[next], root)) {
+                running++;
+            }
+            next++;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error waiting for simulator: %s\n",
+                    strerror(errno));
+            break;
+        }
+        for (int j = 0; j < 2 * N; j++) {
+            if (jobs[j].pid == pid) {
+                jobs[j].status = status;
+                finish_job(&jobs[j]);
+                running--;
+                break;
+            }
+        }
+    }
+
+    /* Like runtrace(), give up on a trace once its reference run failed:
+     * the test run counts as failed, and its results are dropped */
+    for (int i = 0; i < N; i++) {
+        if (!jobs[2 * i].ok) {
+            csim_stats_t *stats = &test_stats[i];
+            jobs[2 * i + 1].ok = false;
+            stats->hits = stats->misses = stats->evictions =
+                stats->dirty_bytes = stats->dirty_evictions = ULONG_MAX;
+        }
+    }
+
+    /* Report failures in trace order, except for the test runs given up on */
+    for (int j = 0; j < 2 * N; j++) {
+        job_t *job = &jobs[j];
+        if (!job->ok && (job->ref || jobs[j - 1].ok)) {
+            char cmd[MAX_STR];
+            format_cmd(job->info, job->ref, job->run, cmd);
+            if (WIFSIGNALED(job->status) &&
+                WTERMSIG(job->status) == SIGALRM) {
+                fprintf(stderr, "Error: Program timed out.\n");
+            }
+            fprintf(stderr, "Running %s simulator failed: '%s'\n",
+                    job->ref ? "reference" : "test", cmd);
+            fprintf(stderr, "\n");
+        }
+    }
+
+    for (int i = 0; i < N; i++) {
+        success[i] = jobs[2 * i].ok && jobs[2 * i + 1].ok;
+    }
+}
+
 /**
  * @brief Counts the number of matching fields in two csim_stats_t structs
  */
@@ -213,7 +450,7 @@ static void print_trace_results(int points, const trace_info_t *info,
  * @brief Checks the student's test simulator for correctness by
  *        comparing its results to the reference simulator.
  */
-static void test_csim(void) {
+static void test_csim(bool batch) {
     /* Output results */
     csim_stats_t ref_stats[N];
     csim_stats_t test_stats[N];
@@ -231,9 +468,18 @@ static void test_csim(void) {
     }
 
     /* Run the individual tests */
+    bool success[N];
+    if (batch) {
+        run_batch(ref_stats, test_stats, success);
+    } else {
+        for (int i = 0; i < N; i++) {
+            success[i] =
+                runtrace(&TRACE_INFO[i], &ref_stats[i], &test_stats[i]);
+        }
+    }
+
     for (int i = 0; i < N; i++) {
-        bool success = runtrace(&TRACE_INFO[i], &ref_stats[i], &test_stats[i]);
-        if (success) {
+        if (success[i]) {
             points[i] = count_matches(&ref_stats[i], &test_stats[i]) *
                         TRACE_INFO[i].weight;
         }
@@ -262,10 +508,14 @@ static void test_csim(void) {
  */
 int main(int argc, char *argv[]) {
     int c;
+    bool batch = false;
 
     /* Parse command line args */
-    while ((c = getopt(argc, argv, "h")) != -1) {
+    while ((c = getopt(argc, argv, "hj")) != -1) {
         switch (c) {
+        case 'j':
+            batch = true;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -281,11 +531,14 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    /* Time out and give up after a while */
-    alarm(20);
+    /* Time out and give up after a while. In batch mode every simulator
+     * has its own timeout instead. */
+    if (!batch) {
+        alarm(JOB_TIMEOUT);
+    }
 
     /* Evaluate the student's cache simulator for correctness */
-    test_csim();
+    test_csim(batch);
 
     exit(0);
 }
@@ -22,6 +22,9 @@
 
 #include "cachelab.h"
 
+/** @brief Number of matrices used to check transBatch() */
+#define BATCH_CHECK_COUNT 5
+
 /** @brief Results of testing the submitted transpose function */
 static struct {
     int funcid;
@@ -110,6 +113,40 @@ cleanup:
     return correct;
 }
 
+/**
+ * @brief Validates transBatch() on a batch of K matrices
+ *
+ * Each matrix in the batch is compared with correctTrans().
+ */
+bool validate_batch(size_t K, size_t M, size_t N) {
+    double(*A)[K][N][M] = xaligned_alloc(64, sizeof(*A));
+    double(*B)[K][M][N] = xaligned_alloc(64, sizeof(*B));
+    double(*T)[TMPCOUNT] = xaligned_alloc(64, sizeof(*T));
+    double(*Bref)[M][N] = xaligned_alloc(64, sizeof(*Bref));
+
+    memset(T, 0, sizeof(*T));
+    for (size_t k = 0; k < K; k++) {
+        initMatrix(M, N, (*A)[k], (*B)[k]);
+    }
+
+    transBatch(K, M, N, *A, *B, *T);
+
+    bool correct = true;
+    for (size_t k = 0; k < K && correct; k++) {
+        correctTrans(M, N, (*A)[k], *Bref);
+        if (memcmp((*B)[k], *Bref, sizeof(*Bref)) != 0) {
+            fprintf(stderr, "Validation failed on batch matrix %zd\n", k);
+            correct = false;
+        }
+    }
+
+    free(A);
+    free(B);
+    free(T);
+    free(Bref);
+    return correct;
+}
+
 /**
  * @brief Evaluate the correctness of the registered transpose functions
  */
@@ -142,6 +179,13 @@ static void eval_trans(size_t M, size_t N, bool submission_only) {
             results.correct = true;
         }
     }
+
+    /* Also check the batched API, unless it would use too much memory */
+    if (!submission_only && M * N <= MAXN * MAXN / BATCH_CHECK_COUNT) {
+        printf("Batch of %d (transBatch): %s\n", BATCH_CHECK_COUNT,
+               validate_batch(BATCH_CHECK_COUNT, M, N) ? "Correct"
+                                                       : "Validation error!");
+    }
 }
 
 /**
@@ -202,6 +246,7 @@ int main(int argc, char *argv[]) {
 
     /* Register transpose functions */
     registerFunctions();
+    registerNativeFunctions();
 
     /* Time out and give up after a while */
     alarm(360);
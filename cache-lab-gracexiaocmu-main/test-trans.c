@@ -7,6 +7,8 @@
  * official submitted version as well.
  */
 
+#define _XOPEN_SOURCE 700 // posix_memalign, clock_gettime, mkdtemp
+
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
@@ -16,14 +18,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h> // for mkdir
 #include <sys/types.h>
 #include <sys/wait.h> // for WEXITSTATUS
+#include <time.h>
 #include <unistd.h>
 
 #include "cachelab.h"
 
-#define CMD_BUFSIZE 334
-#define FILENAME_BUFSIZE 255
+#define CMD_BUFSIZE 8192
+#define FILENAME_BUFSIZE 1024
+
+/** @brief Directory where generated traces are kept between runs */
+#define TRACE_CACHE_DIR ".trace-cache"
+
+/** @brief Object file that tracegen-ct traces, hashed for the cache keys */
+#define TRACE_OBJECT "trans-fin.o"
+
+/** @brief Object file that tracegen-lite traces */
+#define TRACE_OBJECT_LITE "trans-hook.o"
+
+/** @brief Other files tracegen-ct's traces and validation depend on */
+static const char *const trace_deps[] = {"tracegen-ct.o", "cachelab.o",
+                                         "ct/ct.bc", "ct/CLabInst.so", NULL};
+
+/** @brief Other files tracegen-lite's traces and validation depend on */
+static const char *const trace_deps_lite[] = {
+    "tracegen-lite.o", "tracegen-ct.o", "cachelab.o", NULL};
+
+/** @brief Largest number of cache geometries in a sweep */
+#define MAX_SWEEP_POINTS 256
 
 /* Globals set on the command line */
 static size_t M = 0;
@@ -36,6 +60,72 @@ static struct {
     csim_stats_t stats;
 } results = {-1, false, {LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX}};
 
+/** @brief Whether to also estimate cycles with the csim timing model */
+static bool use_timing_model = false;
+
+/** @brief Timing model results for each registered function */
+static struct {
+    bool valid;
+    csim_timing_stats_t stats;
+} timing[MAX_TRANS_FUNCS];
+
+/**
+ * @brief Struct representing one cache geometry of a sweep
+ */
+typedef struct {
+    unsigned int s; /* log2 of the number of sets */
+    unsigned int E; /* associativity */
+    unsigned int b; /* log2 of the block size */
+} sweep_geom_t;
+
+/**
+ * @brief Struct representing the results of one function on one geometry
+ */
+typedef struct {
+    bool valid;           /* whether the simulation succeeded */
+    unsigned long misses; /* misses reported by the reference simulator */
+    unsigned long cycles; /* get_clock_cycles(), or model cycles with -T */
+} sweep_stats_t;
+
+/** @brief Cache geometries swept with -G, in report order */
+static sweep_geom_t sweep_geoms[MAX_SWEEP_POINTS];
+static int sweep_count = 0;
+
+/** @brief Sweep results for each registered function */
+static sweep_stats_t sweep[MAX_TRANS_FUNCS][MAX_SWEEP_POINTS];
+
+/** @brief Number of functions evaluated at once, 0 for one per CPU */
+static int eval_workers = 0;
+
+/** @brief Trace generator run by generate_trace, and the files it uses */
+static const char *tracegen = "tracegen-ct";
+static const char *trace_object = TRACE_OBJECT;
+static const char *const *trace_object_deps = trace_deps;
+
+/** @brief Whether to reuse traces from TRACE_CACHE_DIR */
+static bool use_trace_cache = true;
+
+/** @brief Directory test-trans was started in, where the tools are */
+static char root[FILENAME_BUFSIZE];
+
+/** @brief Whether to time the functions natively instead of simulating */
+static bool use_wall_clock = false;
+
+/** @brief Number of timed runs per function in wall-clock mode */
+static int wall_reps = 5;
+
+/** @brief Largest thread count in the scaling curve, 0 for one per CPU */
+static int wall_threads = 0;
+
+/** @brief Median wall-clock time per element for each registered function */
+static struct {
+    bool valid;
+    double ns_per_elem;
+} wall[MAX_TRANS_FUNCS];
+
+/** @brief Element type kernels timed with -w -e, or NULL for the doubles */
+static const elem_kernels_t *elem = NULL;
+
 /**
  * @brief Calculates the number of clock cycles for the trace
  */
@@ -44,39 +134,53 @@ static unsigned long get_clock_cycles(unsigned long hits,
     return HIT_CYCLES * hits + MISS_CYCLES * misses;
 }
 
+/**
+ * @brief Reports that tracegen rejected a transpose function.
+ *
+ * @param[in] i      Index of the transpose function
+ * @param[in] status Exit status of tracegen
+ */
+static void report_invalid(int i, int status) {
+    printf("Validation error at function %d! Run ./%s -v -M "
+           "%zd -N %zd -F %d for details.\n",
+           i, tracegen, M, N, i);
+    printf("Exit status %d\n", status);
+}
+
 /**
  * @brief Generates a trace file for a specific transpose function.
  *
- * @param[in] file_name File name where the trace should be stored
- * @param[in] i         Index of the transpose function to use
+ * @param[in]  file_name File name where the trace should be stored
+ * @param[in]  i         Index of the transpose function to use
+ * @param[out] check     Exit status of tracegen, 0 if the function was
+ *                       validated, or -1 if tracegen did not run to the end
  *
  * @return True if the function succeeded, and false otherwise
  */
-static bool generate_trace(const char *file_name, int i) {
+static bool generate_trace(const char *file_name, int i, int *check) {
     char cmd[CMD_BUFSIZE];
+    *check = -1;
     snprintf(cmd, sizeof(cmd),
-             "CONTECH_TRACE=%s ./tracegen-ct -M %ld -N %ld -F %d", file_name, M,
-             N, i);
+             "CONTECH_TRACE='%s' '%s/%s' -M %ld -N %ld -F %d", file_name,
+             root, tracegen, M, N, i);
 
     int status = system(cmd);
     if (status < 0) {
-        printf("Failed to run tracegen-ct: %s\n", strerror(errno));
+        printf("Failed to run %s: %s\n", tracegen, strerror(errno));
         return false;
     }
 
     if (!WIFEXITED(status)) {
-        printf("Internal error: ./tracegen-ct aborted for unknown "
+        printf("Internal error: ./%s aborted for unknown "
                "reason (status %x).\n",
-               status);
+               tracegen, status);
         printf("Command run: %s\n", cmd);
         return false;
     }
 
-    if (WEXITSTATUS(status) != 0) {
-        printf("Validation error at function %d! Run ./tracegen-ct -v -M "
-               "%zd -N %zd -F %d for details.\n",
-               i, M, N, i);
-        printf("Exit status %d\n", WEXITSTATUS(status));
+    *check = WEXITSTATUS(status);
+    if (*check != 0) {
+        report_invalid(i, *check);
         return false;
     }
 
@@ -97,8 +201,9 @@ static bool generate_trace(const char *file_name, int i) {
 static bool compute_stats(const char *file_name, unsigned int s, unsigned int E,
                           unsigned int b, csim_stats_t *stats) {
     char cmd[CMD_BUFSIZE];
-    snprintf(cmd, sizeof(cmd), "./csim-ref -s %u -E %u -b %u -t %s > /dev/null",
-             s, E, b, file_name);
+    snprintf(cmd, sizeof(cmd),
+             "'%s/csim-ref' -s %u -E %u -b %u -t '%s' > /dev/null", root, s, E,
+             b, file_name);
 
     int status = system(cmd);
     if (status < 0) {
@@ -125,15 +230,368 @@ static bool compute_stats(const char *file_name, unsigned int s, unsigned int E,
     return true;
 }
 
+/**
+ * @brief Estimate cycles for a trace using the csim timing model.
+ *
+ * Unlike get_clock_cycles(), the timing model charges dirty writebacks,
+ * limits memory bandwidth and overlaps independent misses.
+ *
+ * @param[in]  file_name File name where the trace is be stored
+ * @param[in]  s         log2 of the number of sets
+ * @param[in]  E         associativity
+ * @param[in]  b         log2 of the block size
+ * @param[out] stats     Timing results computed from the trace file
+ *
+ * @return True if the function succeeded, and false otherwise
+ */
+static bool compute_timing(const char *file_name, unsigned int s,
+                           unsigned int E, unsigned int b,
+                           csim_timing_stats_t *stats) {
+    char cmd[CMD_BUFSIZE];
+    snprintf(cmd, sizeof(cmd),
+             "'%s/csim' -s %u -E %u -b %u -t '%s' -T %d,%d,%d,%d,%d "
+             "> /dev/null",
+             root, s, E, b, file_name, TIMING_HIT_CYCLES, TIMING_MISS_CYCLES,
+             TIMING_FILL_CYCLES, TIMING_WRITEBACK_CYCLES, TIMING_MSHRS);
+
+    int status = system(cmd);
+    if (status < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Timing model error.  Command failed: %s\n", cmd);
+        return false;
+    }
+
+    bool success = loadTiming(stats);
+    (void)remove(".csim_timing");
+    (void)remove(".csim_results");
+    return success;
+}
+
+/**
+ * @brief Print the evaluated functions ordered by modeled cycles
+ */
+static void print_timing_ranking(void) {
+    int order[MAX_TRANS_FUNCS];
+    int count = 0;
+
+    for (int i = 0; i < func_counter; i++) {
+        if (!timing[i].valid) {
+            continue;
+        }
+        /* Insertion sort, there are at most MAX_TRANS_FUNCS entries */
+        int j = count++;
+        while (j > 0 && timing[order[j - 1]].stats.cycles >
+                            timing[i].stats.cycles) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    printf("\nRanking by modeled cycles:\n");
+    for (int k = 0; k < count; k++) {
+        int i = order[k];
+        printf("%3d. func %d (%s): model_cycles:%ld stall_cycles:%ld\n",
+               k + 1, i, func_list[i].description, timing[i].stats.cycles,
+               timing[i].stats.stall_cycles);
+    }
+}
+
+/**
+ * @brief Struct representing the evaluation of one function by a worker
+ *
+ * Each worker runs in a private working directory, so that concurrent
+ * simulators do not overwrite each other's .csim_results file. It writes
+ * its progress to a log there, which is printed once all workers are done
+ * so that the report does not depend on the order in which they finish.
+ */
+typedef struct {
+    int func;                   /* index of the transpose function */
+    unsigned long long key;     /* trace cache key, or 0 if not cached */
+    char dir[FILENAME_BUFSIZE]; /* private working directory */
+    pid_t pid;                  /* worker process, or 0 if not running */
+    int status;                 /* wait status of the worker */
+} eval_job_t;
+
+/**
+ * @brief Struct representing the results a worker sends back
+ */
+typedef struct {
+    bool ok;                    /* validated and simulated */
+    csim_stats_t stats;         /* reference simulator results */
+    bool timing_valid;          /* whether timing holds model results */
+    csim_timing_stats_t timing; /* timing model results */
+    sweep_stats_t sweep[MAX_SWEEP_POINTS]; /* results on sweep_geoms */
+} eval_result_t;
+
+/**
+ * @brief Simulates a trace on one geometry of the sweep.
+ */
+static void sweep_point(const char *trace, const sweep_geom_t *g,
+                        sweep_stats_t *out) {
+    csim_stats_t stats;
+
+    out->valid = compute_stats(trace, g->s, g->E, g->b, &stats);
+    (void)remove(".csim_results");
+    if (!out->valid) {
+        return;
+    }
+    out->misses = stats.misses;
+    out->cycles = get_clock_cycles(stats.hits, stats.misses);
+
+    if (use_timing_model) {
+        csim_timing_stats_t model;
+        out->valid = compute_timing(trace, g->s, g->E, g->b, &model);
+        out->cycles = model.cycles;
+    }
+}
+
+/**
+ * @brief Reads the validation result cached at path.
+ *
+ * @return The exit status tracegen had when validating the function, or -1
+ *         if no result is cached
+ */
+static int read_check(const char *path) {
+    int check = -1;
+    FILE *fp = fopen(path, "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%d", &check) != 1 || check < 0) {
+            check = -1;
+        }
+        fclose(fp);
+    }
+    return check;
+}
+
+/**
+ * @brief Caches a validation result at path, under a temporary name first
+ * like the traces.
+ */
+static void write_check(const char *path, int check) {
+    char tmp[3 * FILENAME_BUFSIZE];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (fp != NULL) {
+        bool ok = fprintf(fp, "%d\n", check) > 0;
+        if (fclose(fp) == 0 && ok) {
+            (void)rename(tmp, path);
+        }
+    }
+    (void)remove(tmp);
+}
+
+/**
+ * @brief Validates, traces and simulates one function.
+ *
+ * tracegen validates a function while tracing it, so with the trace cache
+ * the outcome of that validation is cached next to the trace, and replayed
+ * instead: a cached trace is only used along with the result that it was
+ * validated, and a function that failed validation fails again with the
+ * same status without being run. Otherwise the new trace is written under
+ * a temporary name and then renamed, so that a failed or concurrent run
+ * never leaves a partial trace behind.
+ */
+static void eval_function(const eval_job_t *job, unsigned int s,
+                          unsigned int E, unsigned int b, eval_result_t *res) {
+    char trace[2 * FILENAME_BUFSIZE];
+    char check_path[2 * FILENAME_BUFSIZE];
+    int check = -1;
+
+    if (job->key != 0) {
+        snprintf(trace, sizeof(trace), "%s/%s/%016llx.trace", root,
+                 TRACE_CACHE_DIR, job->key);
+        snprintf(check_path, sizeof(check_path), "%s/%s/%016llx.check", root,
+                 TRACE_CACHE_DIR, job->key);
+        check = read_check(check_path);
+    } else {
+        snprintf(trace, sizeof(trace), "%s/trace.f%d", root, job->func);
+    }
+
+    if (check > 0) {
+        printf("Step 1: Using cached validation result %016llx\n", job->key);
+        report_invalid(job->func, check);
+        return;
+    } else if (check == 0 && access(trace, R_OK) == 0) {
+        printf("Step 1: Using cached trace %016llx, validated when traced\n",
+               job->key);
+    } else {
+        char tmp[3 * FILENAME_BUFSIZE];
+        snprintf(tmp, sizeof(tmp), "%s.%ld", trace, (long)getpid());
+        printf("Step 1: Validating and generating memory traces\n");
+        bool traced =
+            generate_trace(tmp, job->func, &check) && rename(tmp, trace) == 0;
+        (void)remove(tmp);
+        if (job->key != 0 && check >= 0 && (traced || check > 0)) {
+            write_check(check_path, check);
+        }
+        if (!traced) {
+            return;
+        }
+    }
+
+    printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    res->ok = compute_stats(trace, s, E, b, &res->stats);
+    (void)remove(".csim_results");
+
+    if (res->ok && use_timing_model) {
+        res->timing_valid = compute_timing(trace, s, E, b, &res->timing);
+    }
+
+    /* The trace does not depend on the cache, so it is reused for each */
+    if (res->ok && sweep_count > 0) {
+        printf("Step 3: Sweeping %d cache geometries\n", sweep_count);
+        for (int k = 0; k < sweep_count; k++) {
+            sweep_point(trace, &sweep_geoms[k], &res->sweep[k]);
+        }
+    }
+}
+
+/**
+ * @brief Runs eval_function() in a worker process, in the job's directory,
+ * and writes its log and results there.
+ */
+static void eval_worker(const eval_job_t *job, unsigned int s, unsigned int E,
+                        unsigned int b) {
+    eval_result_t res;
+
+    memset(&res, 0, sizeof(res));
+    if (chdir(job->dir) < 0 || freopen("log", "w", stdout) == NULL) {
+        _exit(1);
+    }
+
+    eval_function(job, s, E, b, &res);
+    fflush(stdout);
+
+    FILE *fp = fopen("result", "wb");
+    if (fp == NULL || fwrite(&res, sizeof(res), 1, fp) != 1) {
+        _exit(1);
+    }
+    fclose(fp);
+    _exit(0);
+}
+
+/**
+ * @brief Runs the jobs in at most eval_workers processes at once.
+ */
+static void run_eval_jobs(eval_job_t *jobs, int njobs, unsigned int s,
+                          unsigned int E, unsigned int b) {
+    long workers = eval_workers;
+    if (workers <= 0) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    int next = 0;
+    long running = 0;
+    while (next < njobs || running > 0) {
+        while (next < njobs && running < workers) {
+            eval_job_t *job = &jobs[next++];
+            snprintf(job->dir, sizeof(job->dir), "/tmp/test-trans.XXXXXX");
+            if (mkdtemp(job->dir) == NULL) {
+                printf("Error creating job directory: %s\n", strerror(errno));
+                job->dir[0] = '\0';
+                continue;
+            }
+            fflush(stdout);
+            job->pid = fork();
+            if (job->pid < 0) {
+                printf("Error forking worker: %s\n", strerror(errno));
+                job->pid = 0;
+                continue;
+            }
+            if (job->pid == 0) {
+                eval_worker(job, s, E, b);
+            }
+            running++;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error waiting for worker: %s\n", strerror(errno));
+            break;
+        }
+        for (int j = 0; j < njobs; j++) {
+            if (jobs[j].pid == pid) {
+                jobs[j].pid = 0;
+                jobs[j].status = status;
+                running--;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Prints the log of a finished job, reads its results and removes
+ * its working directory.
+ *
+ * @return false if the worker did not send back any results
+ */
+static bool finish_eval_job(const eval_job_t *job, eval_result_t *res) {
+    char path[2 * FILENAME_BUFSIZE];
+    bool ok = false;
+
+    if (job->dir[0] == '\0') {
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/log", job->dir);
+    FILE *fp = fopen(path, "r");
+    if (fp != NULL) {
+        char line[CMD_BUFSIZE];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            fputs(line, stdout);
+        }
+        fclose(fp);
+    }
+    (void)unlink(path);
+
+    snprintf(path, sizeof(path), "%s/result", job->dir);
+    fp = fopen(path, "rb");
+    if (fp != NULL) {
+        ok = WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0 &&
+             fread(res, sizeof(*res), 1, fp) == 1;
+        fclose(fp);
+    }
+    (void)unlink(path);
+    (void)rmdir(job->dir);
+    return ok;
+}
+
 /**
  * @brief Evaluate the performance of the registered transpose functions
+ *
+ * The functions are evaluated concurrently by worker processes. Unless -C
+ * is given, traces are cached in TRACE_CACHE_DIR under a key that hashes
+ * the function's object code and (M, N), so only functions that changed
+ * since the last run are traced again.
  */
 static void eval_perf(unsigned int s, unsigned int E, unsigned int b,
                       bool submission_only) {
+    unsigned long long keys[MAX_TRANS_FUNCS] = {0};
+    eval_job_t jobs[MAX_TRANS_FUNCS];
+    int njobs = 0;
 
     registerFunctions();
 
-    /* Evaluate the performance of each registered transpose function */
+    if (use_trace_cache &&
+        (mkdir(TRACE_CACHE_DIR, 0755) == 0 || errno == EEXIST)) {
+        (void)traceCacheKeys(trace_object, trace_object_deps, M, N, keys);
+    }
+
     for (int i = 0; i < func_counter; i++) {
         /* Remember if this function is the submission */
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0) {
@@ -145,39 +603,390 @@ static void eval_perf(unsigned int s, unsigned int E, unsigned int b,
             continue;
         }
 
-        /* Run and generate a trace file */
-        char file_name[FILENAME_BUFSIZE];
-        sprintf(file_name, "trace.f%d", i);
+        eval_job_t *job = &jobs[njobs++];
+        job->func = i;
+        job->key = keys[i];
+        job->dir[0] = '\0';
+        job->pid = 0;
+        job->status = -1;
+    }
+
+    run_eval_jobs(jobs, njobs, s, E, b);
+
+    /* Report in function order */
+    for (int j = 0; j < njobs; j++) {
+        int i = jobs[j].func;
+        eval_result_t res;
 
         printf("\nFunction %d out of %d (%s)\n", i, func_counter,
                func_list[i].description);
-        printf("Step 1: Validating and generating memory traces\n");
-
-        if (!generate_trace(file_name, i)) {
+        if (!finish_eval_job(&jobs[j], &res) || !res.ok) {
             continue;
         }
 
-        /* Run the reference simulator */
-        csim_stats_t stats;
+        /* Mark this function as correct */
+        printf("Results for func %d (%s): hits:%ld, misses:%ld, evictions:%ld, "
+               "clock_cycles:%ld\n",
+               i, func_list[i].description, res.stats.hits, res.stats.misses,
+               res.stats.evictions,
+               get_clock_cycles(res.stats.hits, res.stats.misses));
+
+        if (res.timing_valid) {
+            timing[i].valid = true;
+            timing[i].stats = res.timing;
+            printf("Timing model for func %d (%s): model_cycles:%ld, "
+                   "stall_cycles:%ld, bus_cycles:%ld\n",
+                   i, func_list[i].description, timing[i].stats.cycles,
+                   timing[i].stats.stall_cycles, timing[i].stats.bus_cycles);
+        }
+
+        memcpy(sweep[i], res.sweep, sizeof(sweep[i]));
+
+        /* If it is transpose_submit(), record number of misses */
+        if (results.funcid == i) {
+            memcpy(&results.stats, &res.stats, sizeof(results.stats));
+            results.correct = true;
+        }
+    }
+}
+
+/**
+ * @brief Prints one matrix of the sweep, with a row per geometry and a
+ * column per function.
+ *
+ * The last row gives each function's worst ratio to the best function on
+ * the same geometry, so a function that degrades gracefully stays near 1.
+ *
+ * @param[in] title  What the matrix holds
+ * @param[in] cycles Print cycles instead of misses
+ */
+static void print_sweep_table(const char *title, bool cycles) {
+    bool shown[MAX_TRANS_FUNCS] = {false};
+    double worst[MAX_TRANS_FUNCS] = {0};
+
+    for (int i = 0; i < func_counter; i++) {
+        for (int k = 0; k < sweep_count; k++) {
+            shown[i] = shown[i] || sweep[i][k].valid;
+        }
+    }
+
+    printf("\nSweep: %s\n", title);
+    printf("%3s %4s %3s %10s", "s", "E", "b", "size");
+    for (int i = 0; i < func_counter; i++) {
+        if (shown[i]) {
+            char label[32];
+            snprintf(label, sizeof(label), "func %d", i);
+            printf(" %11s", label);
+        }
+    }
+    printf("\n");
+
+    for (int k = 0; k < sweep_count; k++) {
+        const sweep_geom_t *g = &sweep_geoms[k];
+        unsigned long best = ULONG_MAX;
+        for (int i = 0; i < func_counter; i++) {
+            unsigned long v = cycles ? sweep[i][k].cycles : sweep[i][k].misses;
+            if (sweep[i][k].valid && v < best) {
+                best = v;
+            }
+        }
+
+        printf("%3u %4u %3u %10lu", g->s, g->E, g->b,
+               (1UL << g->s) * g->E * (1UL << g->b));
+        for (int i = 0; i < func_counter; i++) {
+            if (!shown[i]) {
+                continue;
+            }
+            if (!sweep[i][k].valid) {
+                printf(" %11s", "-");
+                continue;
+            }
+            unsigned long v = cycles ? sweep[i][k].cycles : sweep[i][k].misses;
+            printf(" %11lu", v);
+            if (best > 0 && (double)v / (double)best > worst[i]) {
+                worst[i] = (double)v / (double)best;
+            }
+        }
+        printf("\n");
+    }
+
+    printf("%-23s", "worst vs best");
+    for (int i = 0; i < func_counter; i++) {
+        if (shown[i]) {
+            printf(" %11.2f", worst[i]);
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Parses a range "lo-hi", or a single value, at *str.
+ *
+ * @return false if there is no valid range at *str
+ */
+static bool parse_range(const char **str, unsigned int *lo,
+                        unsigned int *hi) {
+    char *end;
+    unsigned long v = strtoul(*str, &end, 10);
+    if (end == *str || v > MAXN) {
+        return false;
+    }
+    *lo = *hi = (unsigned int)v;
+
+    if (*end == '-') {
+        const char *p = end + 1;
+        v = strtoul(p, &end, 10);
+        if (end == p || v > MAXN) {
+            return false;
+        }
+        *hi = (unsigned int)v;
+    }
+    *str = end;
+    return *lo <= *hi;
+}
+
+/**
+ * @brief Fills sweep_geoms from a "s,E,b" spec of ranges.
+ *
+ * s and b step by one and E doubles, e.g. "4-6,1-8,5" sweeps three set
+ * counts times associativities 1, 2, 4 and 8 with 32-byte blocks.
+ *
+ * @return false if the spec is invalid or has too many geometries
+ */
+static bool parse_sweep(const char *spec) {
+    unsigned int lo[3], hi[3];
+
+    for (int k = 0; k < 3; k++) {
+        if (!parse_range(&spec, &lo[k], &hi[k])) {
+            return false;
+        }
+        if (*spec != (k < 2 ? ',' : '\0')) {
+            return false;
+        }
+        spec++;
+    }
+    if (lo[1] == 0 || hi[0] + hi[2] > 32) {
+        return false;
+    }
+
+    sweep_count = 0;
+    for (unsigned int s = lo[0]; s <= hi[0]; s++) {
+        for (unsigned int E = lo[1]; E <= hi[1]; E *= 2) {
+            for (unsigned int b = lo[2]; b <= hi[2]; b++) {
+                if (sweep_count == MAX_SWEEP_POINTS) {
+                    return false;
+                }
+                sweep_geoms[sweep_count++] = (sweep_geom_t){s, E, b};
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * @brief Compares two doubles for qsort()
+ */
+static int compare_doubles(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * @brief Allocates aligned memory, exiting on failure
+ */
+static void *xaligned_alloc(size_t alignment, size_t size) {
+    void *ptr;
+    int res = posix_memalign(&ptr, alignment, size);
+    if (res != 0) {
+        fprintf(stderr, "Failed to allocate memory: %s\n", strerror(res));
+        exit(1);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Times wall_reps runs of one transpose function.
+ *
+ * @param[out] times The sorted run times in ns, wall_reps of them
+ *
+ * @return The median time per element in ns
+ */
+static double time_func(int i, double A[N][M], double B[M][N], double *T,
+                        double *times) {
+    for (int r = 0; r < wall_reps; r++) {
+        double start = now_ns();
+        (*func_list[i].func_ptr)(M, N, A, B, T);
+        times[r] = now_ns() - start;
+    }
+    qsort(times, (size_t)wall_reps, sizeof(double), compare_doubles);
+    return times[wall_reps / 2] / (double)(M * N);
+}
 
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        if (!compute_stats(file_name, s, E, b, &stats)) {
+/**
+ * @brief Time the registered transpose functions natively.
+ *
+ * The native functions from trans-native.c are registered as well. Like in
+ * tracegen-ct, the matrices live in buffers with room for MAXN x MAXN
+ * elements. Each function runs once as a warm-up, which is also checked
+ * against correctTrans(), then wall_reps more times; the median is kept.
+ * The parallel transpose is also timed for 1 to wall_threads threads.
+ */
+static void eval_wall_clock(bool submission_only) {
+    registerFunctions();
+    registerNativeFunctions();
+    transSetThreads(wall_threads);
+
+    double(*A)[N][M] = xaligned_alloc(64, sizeof(double) * MAXN * MAXN);
+    double(*B)[M][N] = xaligned_alloc(64, sizeof(double) * MAXN * MAXN);
+    double(*Bref)[M][N] = xaligned_alloc(64, sizeof(*Bref));
+    double *T = xaligned_alloc(64, sizeof(double) * TMPCOUNT);
+    double *times = xaligned_alloc(64, sizeof(double) * (size_t)wall_reps);
+
+    memset(A, 0, sizeof(double) * MAXN * MAXN);
+    memset(B, 0, sizeof(double) * MAXN * MAXN);
+    initMatrix(M, N, *A, *B);
+    correctTrans(M, N, *A, *Bref);
+
+    for (int i = 0; i < func_counter; i++) {
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0) {
+            results.funcid = i;
+        }
+        if (submission_only && results.funcid != i) {
             continue;
         }
 
-        (void)remove(".csim_results");
+        printf("\nFunction %d out of %d (%s)\n", i, func_counter,
+               func_list[i].description);
 
-        /* Mark this function as correct */
-        printf("Results for func %d (%s): hits:%ld, misses:%ld, evictions:%ld, "
-               "clock_cycles:%ld\n",
-               i, func_list[i].description, stats.hits, stats.misses,
-               stats.evictions, get_clock_cycles(stats.hits, stats.misses));
+        /* Warm up caches and TLBs, and validate the result */
+        memset(B, 0, sizeof(*B));
+        memset(T, 0, sizeof(double) * TMPCOUNT);
+        (*func_list[i].func_ptr)(M, N, *A, *B, T);
+        if (memcmp(B, Bref, sizeof(*B)) != 0) {
+            printf("Validation error at function %d! Run ./test-trans-simple "
+                   "-M %zd -N %zd for details.\n",
+                   i, M, N);
+            continue;
+        }
+
+        wall[i].valid = true;
+        wall[i].ns_per_elem = time_func(i, *A, *B, T, times);
+        printf("Wall clock for func %d (%s): median_ns_per_element:%.3f, "
+               "min_ns_per_element:%.3f\n",
+               i, func_list[i].description, wall[i].ns_per_elem,
+               times[0] / (double)(M * N));
 
-        /* If it is transpose_submit(), record number of misses */
         if (results.funcid == i) {
-            memcpy(&results.stats, &stats, sizeof(results.stats));
             results.correct = true;
         }
+
+        /* Scaling curve of the parallel transpose */
+        if (strcmp(func_list[i].description, PARALLEL_DESCRIPTION) == 0) {
+            int max_threads = transGetThreads();
+            printf("%8s%18s%10s\n", "Threads", "ns_per_element", "Speedup");
+            double base = 0.0;
+            for (int t = 1; t <= max_threads; t++) {
+                transSetThreads(t);
+                memset(B, 0, sizeof(*B));
+                double ns = time_func(i, *A, *B, T, times);
+                base = t == 1 ? ns : base;
+                printf("%8d%18.3f%10.2f%s\n", t, ns, base / ns,
+                       memcmp(B, Bref, sizeof(*B)) != 0 ? "  INCORRECT" : "");
+            }
+            transSetThreads(wall_threads);
+        }
+    }
+
+    free(A);
+    free(B);
+    free(Bref);
+    free(T);
+    free(times);
+}
+
+/**
+ * @brief Time the tiled and reference kernels for one element type.
+ *
+ * Both are checked against each other on the warm-up run. Used with -e
+ * instead of eval_wall_clock(), since the registered functions only take
+ * doubles.
+ *
+ * @return True if the tiled kernel was correct
+ */
+static bool eval_elem_wall_clock(void) {
+    size_t bytes = elem->size * M * N;
+    void *A = xaligned_alloc(64, bytes);
+    void *B = xaligned_alloc(64, bytes);
+    void *Bref = xaligned_alloc(64, bytes);
+    double *times = xaligned_alloc(64, sizeof(double) * (size_t)wall_reps);
+    void (*kernels[])(size_t, size_t, const void *, void *) = {
+        elem->trans, elem->correct};
+    const char *names[] = {"tiled", "reference"};
+    bool ok;
+
+    elem->init(M, N, A);
+    elem->correct(M, N, A, Bref);
+    memset(B, 0, bytes);
+    elem->trans(M, N, A, B);
+    ok = memcmp(B, Bref, bytes) == 0;
+
+    printf("Element type %s (%zu bytes, %zux%zu tiles): %s\n", elem->name,
+           elem->size, elem->tile, elem->tile, ok ? "correct" : "INCORRECT");
+    for (size_t k = 0; k < 2 && ok; k++) {
+        for (int r = 0; r < wall_reps; r++) {
+            double start = now_ns();
+            kernels[k](M, N, A, B);
+            times[r] = now_ns() - start;
+        }
+        qsort(times, (size_t)wall_reps, sizeof(double), compare_doubles);
+        printf("Wall clock for %s %s: median_ns_per_element:%.3f, "
+               "min_ns_per_element:%.3f\n",
+               elem->name, names[k], times[wall_reps / 2] / (double)(M * N),
+               times[0] / (double)(M * N));
+    }
+
+    free(A);
+    free(B);
+    free(Bref);
+    free(times);
+    return ok;
+}
+
+/**
+ * @brief Print the timed functions ordered by median wall-clock time
+ */
+static void print_wall_ranking(void) {
+    int order[MAX_TRANS_FUNCS];
+    int count = 0;
+
+    for (int i = 0; i < func_counter; i++) {
+        if (!wall[i].valid) {
+            continue;
+        }
+        int j = count++;
+        while (j > 0 &&
+               wall[order[j - 1]].ns_per_elem > wall[i].ns_per_elem) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    printf("\nRanking by median wall-clock time (%zu x %zu, %d runs):\n", M,
+           N, wall_reps);
+    for (int k = 0; k < count; k++) {
+        int i = order[k];
+        printf("%3d. func %d (%s): ns_per_element:%.3f\n", k + 1, i,
+               func_list[i].description, wall[i].ns_per_elem);
     }
 }
 
@@ -185,11 +994,27 @@ static void eval_perf(unsigned int s, unsigned int E, unsigned int b,
  * @brief Print usage info
  */
 static void usage(char *argv[]) {
-    printf("Usage: %s [-h] [-s] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-h] [-s] [-l] [-T] [-C] [-L] [-G <s,E,b>] [-j <n>] "
+           "[-w [-r <reps>] [-p <n>] [-e <type>]] -M <rows> -N <cols>\n",
+           argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -s          Check official submission only.\n");
     printf("  -l          Simulate large (Haswell L1) cache\n");
+    printf("  -T          Also estimate cycles with the csim timing model\n");
+    printf("  -C          Trace every function again, ignoring the cache\n");
+    printf("  -L          Trace with tracegen-lite instead of tracegen-ct\n");
+    printf("  -G <s,E,b>  Also sweep cache geometries given as ranges, e.g.\n"
+           "              4-6,1-8,5 (E doubles, at most %d geometries)\n",
+           MAX_SWEEP_POINTS);
+    printf("  -j <n>      Functions evaluated at once (default: CPUs)\n");
+    printf("  -w          Time natively instead of simulating, including the\n"
+           "              SIMD functions in trans-native.c\n");
+    printf("  -r <reps>   Timed runs per function with -w (default 5)\n");
+    printf("  -p <n>      Threads for the parallel transpose with -w, also\n"
+           "              the end of its scaling curve (default: CPUs)\n");
+    printf("  -e <type>   With -w, time the trans-elem.c kernels for double,\n"
+           "              float, int32, int64 or cdouble instead\n");
     printf("  -M <rows>   Number of destination matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of destination matrix columns (max %d)\n",
            MAXN);
@@ -228,7 +1053,7 @@ int main(int argc, char *argv[]) {
     bool submission_only = false;
     bool use_large_cache = false;
 
-    while ((c = getopt(argc, argv, "hcslM:N:")) != -1) {
+    while ((c = getopt(argc, argv, "hcslTCLG:j:wr:p:e:M:N:")) != -1) {
         switch (c) {
         case 'M':
             M = (size_t)atoi(optarg);
@@ -242,6 +1067,44 @@ int main(int argc, char *argv[]) {
         case 'l':
             use_large_cache = true;
             break;
+        case 'T':
+            use_timing_model = true;
+            break;
+        case 'C':
+            use_trace_cache = false;
+            break;
+        case 'L':
+            tracegen = "tracegen-lite";
+            trace_object = TRACE_OBJECT_LITE;
+            trace_object_deps = trace_deps_lite;
+            break;
+        case 'G':
+            if (!parse_sweep(optarg)) {
+                printf("Error: Invalid sweep %s\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'j':
+            eval_workers = atoi(optarg);
+            break;
+        case 'w':
+            use_wall_clock = true;
+            break;
+        case 'r':
+            wall_reps = atoi(optarg);
+            break;
+        case 'p':
+            wall_threads = atoi(optarg);
+            break;
+        case 'e':
+            elem = findElemKernels(optarg);
+            if (elem == NULL) {
+                printf("Error: Unknown element type %s\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -263,6 +1126,29 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    if (elem != NULL && !use_wall_clock) {
+        printf("Error: -e requires -w (simulate with trans-tune -e)\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (sweep_count > 0 && use_wall_clock) {
+        printf("Error: -G cannot be combined with -w\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (getcwd(root, sizeof(root)) == NULL) {
+        printf("Error getting working directory: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    if (wall_reps < 1 || wall_threads < 0) {
+        printf("Error: reps must be positive and threads non-negative\n");
+        usage(argv);
+        exit(1);
+    }
+
     /* Install SIGSEGV and SIGALRM handlers */
     if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
         fprintf(stderr, "Unable to install SIGALRM handler\n");
@@ -277,6 +1163,24 @@ int main(int argc, char *argv[]) {
     /* Time out and give up after a while */
     alarm(360);
 
+    if (use_wall_clock && elem != NULL) {
+        return eval_elem_wall_clock() ? 0 : 1;
+    }
+
+    if (use_wall_clock) {
+        eval_wall_clock(submission_only);
+        print_wall_ranking();
+        if (results.funcid == -1 || !results.correct) {
+            printf("\nError: transpose_submit() was not timed\n");
+            return 1;
+        }
+        printf("\nSummary for official submission (func %d): correctness=%d "
+               "ns_per_element=%.3f\n",
+               results.funcid, results.correct,
+               wall[results.funcid].ns_per_elem);
+        return 0;
+    }
+
     /* Check the performance of the student's transpose function */
     if (use_large_cache) {
         /* Use Haswell L1 cache */
@@ -287,6 +1191,15 @@ int main(int argc, char *argv[]) {
         eval_perf(TEST_LOG_SET, TEST_ASSOC, TEST_LOG_BLOCK, submission_only);
     }
 
+    print_timing_ranking();
+
+    if (sweep_count > 0) {
+        print_sweep_table("misses", false);
+        print_sweep_table(use_timing_model ? "model cycles"
+                                           : "cycles (hits and misses)",
+                          true);
+    }
+
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
         printf("\nError: We could not find your transpose_submit() function\n");
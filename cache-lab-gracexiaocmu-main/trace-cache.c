@@ -0,0 +1,431 @@
+/**
+ * @file trace-cache.c
+ * @brief Keys for caching the traces of transpose functions
+ *
+ * A trace only depends on the code that produced it and on the matrix
+ * shape, so test-trans can reuse a trace as long as neither has changed.
+ * The key of a registered function hashes, from the object file that was
+ * traced:
+ *
+ *   - the bytes of the function itself and the relocations inside it, taken
+ *     relative to the function so they do not depend on where it was placed;
+ *   - the same for every registered function it refers to, directly or
+ *     through other registered functions;
+ *   - the same for every other function and data object in that file (the
+ *     helpers and tables it may use), except registerFunctions(), which only
+ *     decides the function numbers;
+ *   - the whole of every other file the trace depends on: the objects of
+ *     the driver that runs and validates the functions, and for tracegen-ct
+ *     the Contech pass and runtime that instrument them;
+ *   - M and N.
+ *
+ * So editing one transpose function only invalidates its own traces and
+ * those of its callers, while editing a shared helper invalidates all of
+ * them. Calls within one section carry no relocation, so registered
+ * functions that share a section are treated as calling each other; the
+ * Makefile builds trans-fin.o with -ffunction-sections to avoid that.
+ * Registered functions are found by name, using the symbol table of the
+ * running executable.
+ */
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+/** @brief An ELF64 file read into memory */
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    const Elf64_Shdr *shdrs;
+    size_t nsections;
+    const Elf64_Sym *syms;
+    size_t nsyms;
+    const char *strtab;
+} elf_t;
+
+/** @brief FNV-1a offset basis and prime */
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief Folds size bytes at data into an FNV-1a hash.
+ */
+static uint64_t fnv(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Folds the whole contents of a file into an FNV-1a hash.
+ *
+ * @return false if the file cannot be read
+ */
+static bool hash_file(const char *path, uint64_t *hash) {
+    unsigned char buf[1 << 16];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        *hash = fnv(*hash, buf, n);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+/**
+ * @brief Frees an ELF file read by elf_load().
+ */
+static void elf_free(elf_t *elf) {
+    free(elf->data);
+    elf->data = NULL;
+}
+
+/**
+ * @brief Reads a 64-bit ELF file and locates its symbol table.
+ *
+ * @return false if the file cannot be read, is not ELF64 or has no symbols
+ */
+static bool elf_load(const char *path, elf_t *elf) {
+    memset(elf, 0, sizeof(*elf));
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? ftell(fp) : -1;
+    ok = size > (long)sizeof(Elf64_Ehdr) && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok) {
+        elf->size = (size_t)size;
+        elf->data = malloc(elf->size);
+        ok = elf->data != NULL &&
+             fread(elf->data, 1, elf->size, fp) == elf->size;
+    }
+    fclose(fp);
+
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)elf->data;
+    ok = ok && memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 &&
+         eh->e_ident[EI_CLASS] == ELFCLASS64 &&
+         eh->e_shentsize == sizeof(Elf64_Shdr) &&
+         eh->e_shoff + eh->e_shnum * sizeof(Elf64_Shdr) <= elf->size;
+    if (!ok) {
+        elf_free(elf);
+        return false;
+    }
+
+    elf->shdrs = (const Elf64_Shdr *)(elf->data + eh->e_shoff);
+    elf->nsections = eh->e_shnum;
+    for (size_t i = 0; i < elf->nsections; i++) {
+        const Elf64_Shdr *sh = &elf->shdrs[i];
+        if (sh->sh_type != SHT_SYMTAB || sh->sh_link >= elf->nsections) {
+            continue;
+        }
+        const Elf64_Shdr *str = &elf->shdrs[sh->sh_link];
+        if (sh->sh_offset + sh->sh_size > elf->size ||
+            str->sh_offset + str->sh_size > elf->size) {
+            break;
+        }
+        elf->syms = (const Elf64_Sym *)(elf->data + sh->sh_offset);
+        elf->nsyms = sh->sh_size / sizeof(Elf64_Sym);
+        elf->strtab = (const char *)(elf->data + str->sh_offset);
+        return true;
+    }
+    elf_free(elf);
+    return false;
+}
+
+/**
+ * @brief Returns the name of a symbol.
+ */
+static const char *sym_name(const elf_t *elf, const Elf64_Sym *sym) {
+    return elf->strtab + sym->st_name;
+}
+
+/**
+ * @brief Whether a symbol is a function or object defined in a section.
+ */
+static bool sym_defined(const elf_t *elf, const Elf64_Sym *sym) {
+    int type = ELF64_ST_TYPE(sym->st_info);
+    return (type == STT_FUNC || type == STT_OBJECT) && sym->st_size > 0 &&
+           sym->st_shndx != SHN_UNDEF && sym->st_shndx < elf->nsections;
+}
+
+/**
+ * @brief Looks up a defined symbol by name.
+ */
+static const Elf64_Sym *find_sym(const elf_t *elf, const char *name) {
+    for (size_t i = 0; i < elf->nsyms; i++) {
+        const Elf64_Sym *sym = &elf->syms[i];
+        if (sym_defined(elf, sym) && strcmp(sym_name(elf, sym), name) == 0) {
+            return sym;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Resolves the target of a relocation to the symbol it points into.
+ *
+ * References to static functions and data are often made relative to their
+ * section. Those are mapped back to the symbol containing the target, so
+ * that the hash does not change when unrelated code moves.
+ *
+ * @param[out] offset Offset of the target from the start of the symbol
+ *
+ * @return The target symbol, or NULL if the relocation has none
+ */
+static const Elf64_Sym *reloc_target(const elf_t *elf, const Elf64_Rela *rela,
+                                     int64_t *offset) {
+    size_t idx = ELF64_R_SYM(rela->r_info);
+    if (idx >= elf->nsyms) {
+        return NULL;
+    }
+    const Elf64_Sym *target = &elf->syms[idx];
+    *offset = rela->r_addend;
+    if (ELF64_ST_TYPE(target->st_info) != STT_SECTION) {
+        return target;
+    }
+
+    /* PC-relative references point 4 bytes before their target */
+    for (int64_t bias = 0; bias <= 4; bias += 4) {
+        uint64_t addr = (uint64_t)(rela->r_addend + bias);
+        for (size_t i = 0; i < elf->nsyms; i++) {
+            const Elf64_Sym *sym = &elf->syms[i];
+            if (sym_defined(elf, sym) && sym->st_shndx == target->st_shndx &&
+                addr >= sym->st_value && addr < sym->st_value + sym->st_size) {
+                *offset = rela->r_addend - (int64_t)sym->st_value;
+                return sym;
+            }
+        }
+    }
+    return target;
+}
+
+/**
+ * @brief Calls visit() for each relocation that patches a symbol, passing
+ * along ctx and the running hash.
+ *
+ * @return The hash returned by the last call to visit()
+ */
+static uint64_t for_each_reloc(const elf_t *elf, const Elf64_Sym *sym,
+                               uint64_t hash, const void *ctx,
+                               uint64_t (*visit)(const elf_t *elf,
+                                                 const Elf64_Rela *rela,
+                                                 uint64_t offset,
+                                                 const void *ctx,
+                                                 uint64_t hash)) {
+    uint64_t start = sym->st_value, end = sym->st_value + sym->st_size;
+
+    for (size_t i = 0; i < elf->nsections; i++) {
+        const Elf64_Shdr *rs = &elf->shdrs[i];
+        if (rs->sh_type != SHT_RELA || rs->sh_info != sym->st_shndx ||
+            rs->sh_offset + rs->sh_size > elf->size) {
+            continue;
+        }
+        const Elf64_Rela *rela =
+            (const Elf64_Rela *)(elf->data + rs->sh_offset);
+        for (size_t j = 0; j < rs->sh_size / sizeof(Elf64_Rela); j++) {
+            if (rela[j].r_offset >= start && rela[j].r_offset < end) {
+                hash = visit(elf, &rela[j], rela[j].r_offset - start, ctx,
+                             hash);
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Folds one relocation, relative to its symbol, into a hash.
+ */
+static uint64_t hash_reloc(const elf_t *elf, const Elf64_Rela *rela,
+                           uint64_t offset, const void *ctx, uint64_t hash) {
+    int64_t addend;
+    const Elf64_Sym *target = reloc_target(elf, rela, &addend);
+    uint64_t fields[3] = {offset, ELF64_R_TYPE(rela->r_info),
+                          (uint64_t)addend};
+
+    hash = fnv(hash, fields, sizeof(fields));
+    if (target != NULL) {
+        const char *name = sym_name(elf, target);
+        hash = fnv(hash, name, strlen(name) + 1);
+    }
+    return hash;
+}
+
+/**
+ * @brief Hashes the contents of a symbol in a relocatable object file,
+ * including the relocations that patch it.
+ */
+static uint64_t hash_sym(const elf_t *elf, const Elf64_Sym *sym,
+                         uint64_t hash) {
+    const Elf64_Shdr *sec = &elf->shdrs[sym->st_shndx];
+    uint64_t end = sym->st_value + sym->st_size;
+
+    hash = fnv(hash, sym_name(elf, sym), strlen(sym_name(elf, sym)) + 1);
+    hash = fnv(hash, &sym->st_size, sizeof(sym->st_size));
+    if (sec->sh_type != SHT_NOBITS && end <= sec->sh_size &&
+        sec->sh_offset + end <= elf->size) {
+        hash = fnv(hash, elf->data + sec->sh_offset + sym->st_value,
+                   sym->st_size);
+    }
+    return for_each_reloc(elf, sym, hash, NULL, hash_reloc);
+}
+
+/**
+ * @brief Sets the hash to 1 if the relocation points into the symbol ctx.
+ */
+static uint64_t find_reference(const elf_t *elf, const Elf64_Rela *rela,
+                               uint64_t offset, const void *ctx,
+                               uint64_t found) {
+    int64_t addend;
+    return found || reloc_target(elf, rela, &addend) == ctx;
+}
+
+/**
+ * @brief Whether the code or data of sym refers to target.
+ */
+static bool refers_to(const elf_t *elf, const Elf64_Sym *sym,
+                      const Elf64_Sym *target) {
+    return for_each_reloc(elf, sym, 0, target, find_reference) != 0;
+}
+
+/**
+ * @brief Finds the names of the registered functions in the executable.
+ *
+ * The load address is recovered from registerFunctions(), so this also
+ * works for position-independent executables.
+ *
+ * @return false if the executable's symbols cannot be read
+ */
+static bool registered_names(const char *names[MAX_TRANS_FUNCS],
+                             elf_t *exe) {
+    if (!elf_load("/proc/self/exe", exe)) {
+        return false;
+    }
+    const Elf64_Sym *reg = find_sym(exe, "registerFunctions");
+    if (reg == NULL) {
+        elf_free(exe);
+        return false;
+    }
+    uintptr_t bias = (uintptr_t)registerFunctions - (uintptr_t)reg->st_value;
+
+    for (int f = 0; f < func_counter; f++) {
+        names[f] = NULL;
+        uintptr_t addr = (uintptr_t)func_list[f].func_ptr - bias;
+        for (size_t i = 0; i < exe->nsyms; i++) {
+            const Elf64_Sym *sym = &exe->syms[i];
+            if (ELF64_ST_TYPE(sym->st_info) == STT_FUNC &&
+                sym->st_value == addr) {
+                names[f] = sym_name(exe, sym);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Computes the trace cache keys of the registered functions.
+ *
+ * @param[in]  obj_path The object file that tracegen-ct was linked from
+ * @param[in]  deps     NULL-terminated list of the other files the traces
+ *                      depend on, hashed as a whole
+ * @param[in]  M        Width of A
+ * @param[in]  N        Height of A
+ * @param[out] keys     Key of each registered function, or 0 if it has
+ *                      none and must always be traced
+ *
+ * @return false if no keys could be computed at all
+ */
+bool traceCacheKeys(const char *obj_path, const char *const deps[],
+                    size_t M, size_t N,
+                    unsigned long long keys[MAX_TRANS_FUNCS]) {
+    const char *names[MAX_TRANS_FUNCS];
+    elf_t exe, obj;
+
+    memset(keys, 0, sizeof(keys[0]) * MAX_TRANS_FUNCS);
+    if (!registered_names(names, &exe)) {
+        return false;
+    }
+    if (!elf_load(obj_path, &obj)) {
+        elf_free(&exe);
+        return false;
+    }
+
+    /* Everything the functions may share */
+    uint64_t shared = FNV_OFFSET;
+    for (size_t i = 0; i < obj.nsyms; i++) {
+        const Elf64_Sym *sym = &obj.syms[i];
+        const char *name = sym_name(&obj, sym);
+        bool registered = strcmp(name, "registerFunctions") == 0;
+        for (int f = 0; f < func_counter && !registered; f++) {
+            registered = names[f] != NULL && strcmp(names[f], name) == 0;
+        }
+        if (sym_defined(&obj, sym) && !registered) {
+            shared = hash_sym(&obj, sym, shared);
+        }
+    }
+    for (size_t i = 0; deps[i] != NULL; i++) {
+        if (!hash_file(deps[i], &shared)) {
+            elf_free(&obj);
+            elf_free(&exe);
+            return false;
+        }
+    }
+    shared = fnv(shared, &M, sizeof(M));
+    shared = fnv(shared, &N, sizeof(N));
+
+    /*
+     * Registered functions may also call each other, even indirectly. The
+     * assembler resolves calls within a section without a relocation, so
+     * unless the object was built with -ffunction-sections, functions that
+     * share a section are assumed to call each other.
+     */
+    const Elf64_Sym *syms[MAX_TRANS_FUNCS];
+    uint64_t own[MAX_TRANS_FUNCS];
+    static bool calls[MAX_TRANS_FUNCS][MAX_TRANS_FUNCS];
+    for (int f = 0; f < func_counter; f++) {
+        syms[f] = names[f] != NULL ? find_sym(&obj, names[f]) : NULL;
+        own[f] = syms[f] != NULL ? hash_sym(&obj, syms[f], FNV_OFFSET) : 0;
+    }
+    for (int f = 0; f < func_counter; f++) {
+        for (int g = 0; g < func_counter; g++) {
+            calls[f][g] = f == g ||
+                          (syms[f] != NULL && syms[g] != NULL &&
+                           (syms[f]->st_shndx == syms[g]->st_shndx ||
+                            refers_to(&obj, syms[f], syms[g])));
+        }
+    }
+    for (int k = 0; k < func_counter; k++) {
+        for (int f = 0; f < func_counter; f++) {
+            for (int g = 0; g < func_counter; g++) {
+                calls[f][g] = calls[f][g] || (calls[f][k] && calls[k][g]);
+            }
+        }
+    }
+
+    for (int f = 0; f < func_counter; f++) {
+        if (syms[f] == NULL) {
+            continue;
+        }
+        uint64_t key = shared;
+        for (int g = 0; g < func_counter; g++) {
+            if (calls[f][g]) {
+                key = fnv(key, &own[g], sizeof(own[g]));
+            }
+        }
+        keys[f] = key + (key == 0); /* 0 means no key */
+    }
+
+    elf_free(&obj);
+    elf_free(&exe);
+    return true;
+}
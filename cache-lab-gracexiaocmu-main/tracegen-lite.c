@@ -0,0 +1,244 @@
+/**
+ * @file tracegen-lite.c
+ * @brief Records memory traces of the transpose functions without LLVM
+ *
+ * tracegen-ct gets its traces from Contech, which instruments trans.c at
+ * the LLVM IR level and so needs clang 7 and the prebuilt passes in ct/.
+ * tracegen-lite is the same program, running entry() from tracegen-ct.c
+ * with the same options, validation and CONTECH_TRACE variable, but linked
+ * against trans-hook.o, whose LD/ST accessors report every access to A, B
+ * and tmp through transHookAccess(). It builds with any C compiler.
+ *
+ * Between __roi_begin() and __roi_end(), each access is appended to an
+ * in-memory buffer of TRACE_RECORDS records, which is drained to the trace
+ * file whenever it fills up and at the end of the region, so tracing costs
+ * a store per access and one large write per TRACE_RECORDS accesses. A
+ * record is the accessed address, with RECORD_STORE set for stores.
+ *
+ * The trace is written as text in the format read by csim ("L 7f00c0,8").
+ * With -b it is written in binary instead: TRACE_MAGIC followed by the
+ * records as native-endian 64-bit words, less than half the size of the
+ * text. -d converts a binary trace back to text on stdout.
+ *
+ * Unlike Contech, only the accesses to the matrices and tmp are recorded,
+ * not the loads of the tiling tables and other data in trans.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+/** @brief Number of records buffered before they are written out */
+#define TRACE_RECORDS (1 << 16)
+
+/** @brief Longest text line: op, space, 16 hex digits and ",8\n" */
+#define TRACE_LINE_MAX 24
+
+/** @brief First bytes of a binary trace */
+#define TRACE_MAGIC "CLTRACE1"
+
+/** @brief Flag marking a record as a store */
+#define RECORD_STORE (UINT64_C(1) << 63)
+
+/* External function defined in tracegen-ct.c */
+extern int entry(int argc, char *argv[]);
+
+/** @brief Records of the current region, not yet written to the trace */
+static uint64_t records[TRACE_RECORDS];
+static size_t nrecords = 0;
+
+/** @brief Text of the records being written */
+static char text[TRACE_RECORDS * TRACE_LINE_MAX];
+
+/** @brief Whether accesses are being recorded */
+static bool in_roi = false;
+
+/** @brief Trace file, and whether it is written in binary */
+static FILE *trace = NULL;
+static bool binary = false;
+
+/**
+ * @brief Formats one record as a line of text at p.
+ *
+ * All accesses in trans.c are to doubles, so every line has size 8.
+ *
+ * @return The end of the line
+ */
+static char *format_record(char *p, uint64_t record) {
+    static const char digits[] = "0123456789abcdef";
+    uint64_t addr = record & ~RECORD_STORE;
+    char hex[16];
+    int n = 0;
+
+    do {
+        hex[n++] = digits[addr & 0xf];
+        addr >>= 4;
+    } while (addr != 0);
+
+    *p++ = (record & RECORD_STORE) ? 'S' : 'L';
+    *p++ = ' ';
+    while (n > 0) {
+        *p++ = hex[--n];
+    }
+    memcpy(p, ",8\n", 3);
+    return p + 3;
+}
+
+/**
+ * @brief Writes the buffered records to the trace, and empties the buffer.
+ *
+ * Exits on a write error, as the trace would be incomplete.
+ */
+static void drain(void) {
+    size_t size;
+    const void *data;
+
+    if (nrecords == 0) {
+        return;
+    }
+
+    if (binary) {
+        data = records;
+        size = nrecords * sizeof(records[0]);
+    } else {
+        char *p = text;
+        for (size_t i = 0; i < nrecords; i++) {
+            p = format_record(p, records[i]);
+        }
+        data = text;
+        size = (size_t)(p - text);
+    }
+
+    if (fwrite(data, 1, size, trace) != size) {
+        fprintf(stderr, "Error: failed to write trace\n");
+        exit(1);
+    }
+    nrecords = 0;
+}
+
+/**
+ * @brief Starts recording accesses.
+ */
+void __roi_begin(void) {
+    in_roi = true;
+}
+
+/**
+ * @brief Stops recording accesses, and writes out those of the region.
+ */
+void __roi_end(void) {
+    drain();
+    in_roi = false;
+}
+
+/**
+ * @brief Records one access by the hooked kernels in trans.c.
+ */
+void transHookAccess(char op, const void *addr) {
+    if (!in_roi) {
+        return;
+    }
+
+    uint64_t record = (uint64_t)(uintptr_t)addr;
+    if (op == 'S') {
+        record |= RECORD_STORE;
+    }
+    records[nrecords++] = record;
+    if (nrecords == TRACE_RECORDS) {
+        drain();
+    }
+}
+
+/**
+ * @brief Prints the binary trace at path as text on stdout.
+ *
+ * @return True on success, and false otherwise
+ */
+static bool decode(const char *path) {
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        perror(path);
+        return false;
+    }
+
+    if (fread(magic, sizeof(magic), 1, in) != 1 ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "Error: %s is not a binary trace\n", path);
+        fclose(in);
+        return false;
+    }
+
+    trace = stdout;
+    while ((nrecords = fread(records, sizeof(records[0]), TRACE_RECORDS,
+                             in)) > 0) {
+        drain();
+    }
+
+    bool ok = !ferror(in);
+    if (!ok) {
+        perror(path);
+    }
+    fclose(in);
+    return ok;
+}
+
+/**
+ * @brief Main routine
+ *
+ * Handles the options of tracegen-lite itself, and passes the rest on to
+ * entry() in tracegen-ct.c.
+ */
+int main(int argc, char *argv[]) {
+    const char *decode_path = NULL;
+    int kept = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            binary = true;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            decode_path = argv[++i];
+        } else {
+            if (strcmp(argv[i], "-h") == 0) {
+                fprintf(stderr, "tracegen-lite also accepts:\n");
+                fprintf(stderr, "  -b       Write a binary trace\n");
+                fprintf(stderr, "  -d FILE  Print binary trace FILE as "
+                                "text\n\n");
+            }
+            argv[kept++] = argv[i];
+        }
+    }
+    argv[kept] = NULL;
+
+    if (decode_path != NULL) {
+        return decode(decode_path) ? 0 : 1;
+    }
+
+    const char *path = getenv("CONTECH_TRACE");
+    if (path == NULL) {
+        path = "default.trace";
+    }
+    trace = fopen(path, binary ? "wb" : "w");
+    if (trace == NULL) {
+        perror(path);
+        return 1;
+    }
+    if (binary &&
+        fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1, 1, trace) != 1) {
+        fprintf(stderr, "Error: failed to write trace\n");
+        return 1;
+    }
+
+    int status = entry(kept, argv);
+
+    drain();
+    if (fclose(trace) != 0) {
+        fprintf(stderr, "Error: failed to write trace\n");
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,339 @@
+/**
+ * @file tracegen-syn.c
+ * @brief Generates synthetic memory traces for the cache simulator
+ *
+ * Each trace follows one parameterized access pattern over a working set
+ * of a given footprint, with a configurable fraction of stores. The
+ * output uses the same "L addr,size" / "S addr,size" format as the traces
+ * in traces/csim, so it can be fed directly to csim and csim-ref.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Base address of the synthetic working set */
+#define BASE_ADDR 0x10000000UL
+
+/** @brief Cache line size used to lay out pointer-chase nodes */
+#define LINE_SIZE 64
+
+/** @brief Access patterns supported by the generator */
+typedef enum { SEQ, STRIDE, RANDOM, ZIPF, CHASE, TILE } pattern_t;
+
+static const char *PATTERN_NAMES[] = {"seq",  "stride", "random",
+                                      "zipf", "chase",  "tile"};
+
+/** @brief Parameters of the generated trace */
+typedef struct {
+    pattern_t pattern;       /* access pattern */
+    unsigned long accesses;  /* number of accesses to generate */
+    unsigned long footprint; /* size of the working set in bytes */
+    unsigned long stride;    /* stride in bytes for the stride pattern */
+    unsigned long elem;      /* size of each access in bytes */
+    unsigned long tile;      /* tile edge in elements for the tile pattern */
+    double store_frac;       /* fraction of accesses that are stores */
+    double zipf_s;           /* exponent of the Zipf distribution */
+    uint64_t seed;           /* random seed */
+} params_t;
+
+/** @brief State of the xorshift64* generator, so traces are reproducible */
+static uint64_t rng_state;
+
+/**
+ * @brief Returns the next pseudo-random 64-bit value.
+ */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/**
+ * @brief Returns a pseudo-random value uniformly distributed in [0, 1).
+ */
+static double rng_double(void) {
+    return (double)(rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Returns a pseudo-random value uniformly distributed in [0, n).
+ */
+static unsigned long rng_below(unsigned long n) {
+    return (unsigned long)(rng_next() % n);
+}
+
+/**
+ * @brief Emits one access, choosing a load or store by the store fraction.
+ */
+static void emit(FILE *fp, const params_t *p, unsigned long offset) {
+    char op = rng_double() < p->store_frac ? 'S' : 'L';
+    fprintf(fp, "%c %lx,%lu\n", op, BASE_ADDR + offset, p->elem);
+}
+
+/**
+ * @brief Builds the cumulative distribution of a Zipf law over n ranks.
+ *
+ * @return The CDF, or NULL if out of memory
+ */
+static double *zipf_cdf(unsigned long n, double s) {
+    double *cdf = malloc(n * sizeof(double));
+    if (cdf == NULL) {
+        return NULL;
+    }
+    double sum = 0.0;
+    for (unsigned long k = 0; k < n; k++) {
+        sum += 1.0 / pow((double)(k + 1), s);
+        cdf[k] = sum;
+    }
+    for (unsigned long k = 0; k < n; k++) {
+        cdf[k] /= sum;
+    }
+    return cdf;
+}
+
+/**
+ * @brief Fills perm with a random permutation of 0..n-1.
+ *
+ * With cycle set, the permutation is a single cycle (Sattolo's
+ * algorithm), so following it visits every element before repeating.
+ */
+static void random_perm(unsigned long *perm, unsigned long n, bool cycle) {
+    for (unsigned long i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    for (unsigned long i = n - 1; i > 0; i--) {
+        unsigned long j = cycle ? rng_below(i) : rng_below(i + 1);
+        unsigned long t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+}
+
+/**
+ * @brief Generates the trace described by p.
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+static int generate(FILE *fp, const params_t *p) {
+    unsigned long nelems = p->footprint / p->elem;
+    unsigned long *perm = NULL;
+    double *cdf = NULL;
+
+    switch (p->pattern) {
+    case SEQ:
+        for (unsigned long i = 0; i < p->accesses; i++) {
+            emit(fp, p, (i % nelems) * p->elem);
+        }
+        break;
+
+    case STRIDE:
+        for (unsigned long i = 0, off = 0; i < p->accesses; i++) {
+            emit(fp, p, off);
+            off += p->stride;
+            if (off + p->elem > p->footprint) {
+                /* Shift each pass by one element to cover the footprint */
+                off = (off + p->elem) % p->stride;
+            }
+        }
+        break;
+
+    case RANDOM:
+        for (unsigned long i = 0; i < p->accesses; i++) {
+            emit(fp, p, rng_below(nelems) * p->elem);
+        }
+        break;
+
+    case ZIPF:
+        /* Rank r is stored at a random element, so hot data is scattered */
+        cdf = zipf_cdf(nelems, p->zipf_s);
+        perm = malloc(nelems * sizeof(unsigned long));
+        if (cdf == NULL || perm == NULL) {
+            break;
+        }
+        random_perm(perm, nelems, false);
+        for (unsigned long i = 0; i < p->accesses; i++) {
+            double u = rng_double();
+            unsigned long lo = 0, hi = nelems - 1;
+            while (lo < hi) {
+                unsigned long mid = lo + (hi - lo) / 2;
+                if (cdf[mid] < u) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            emit(fp, p, perm[lo] * p->elem);
+        }
+        break;
+
+    case CHASE: {
+        /* One node per line, linked in a single random cycle */
+        unsigned long nodes = p->footprint / LINE_SIZE;
+        if (nodes < 2) {
+            nodes = 2;
+        }
+        perm = malloc(nodes * sizeof(unsigned long));
+        if (perm == NULL) {
+            break;
+        }
+        random_perm(perm, nodes, true);
+        for (unsigned long i = 0, node = 0; i < p->accesses; i++) {
+            emit(fp, p, node * LINE_SIZE);
+            node = perm[node];
+        }
+        break;
+    }
+
+    case TILE: {
+        /* Square matrix filling the footprint, walked tile by tile */
+        unsigned long dim = (unsigned long)sqrt((double)nelems);
+        unsigned long t = p->tile;
+        unsigned long i = 0;
+        while (i < p->accesses) {
+            for (unsigned long r0 = 0; r0 < dim && i < p->accesses; r0 += t) {
+                for (unsigned long c0 = 0; c0 < dim && i < p->accesses;
+                     c0 += t) {
+                    for (unsigned long r = r0;
+                         r < r0 + t && r < dim && i < p->accesses; r++) {
+                        for (unsigned long c = c0;
+                             c < c0 + t && c < dim && i < p->accesses; c++) {
+                            emit(fp, p, (r * dim + c) * p->elem);
+                            i++;
+                        }
+                    }
+                }
+            }
+        }
+        break;
+    }
+    }
+
+    bool oom = (p->pattern == ZIPF && (cdf == NULL || perm == NULL)) ||
+               (p->pattern == CHASE && perm == NULL);
+    free(cdf);
+    free(perm);
+    return oom ? -1 : 0;
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] -p <pattern> [options]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -p <pattern> seq, stride, random, zipf, chase or tile\n");
+    printf("  -n <count>   Number of accesses (default 1000000)\n");
+    printf("  -f <bytes>   Working set footprint (default 1048576)\n");
+    printf("  -w <frac>    Fraction of accesses that are stores (default 0)\n");
+    printf("  -e <bytes>   Size of each access (default 8)\n");
+    printf("  -S <bytes>   Stride for the stride pattern (default 64)\n");
+    printf("  -k <elems>   Tile edge for the tile pattern (default 8)\n");
+    printf("  -z <s>       Exponent for the zipf pattern (default 0.99)\n");
+    printf("  -r <seed>    Random seed (default 1)\n");
+    printf("  -o <file>    Output file (default stdout)\n");
+    printf("Example: %s -p zipf -n 100000 -w 0.3 -o zipf.trace\n", argv[0]);
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    params_t p = {
+        .pattern = SEQ,
+        .accesses = 1000000,
+        .footprint = 1 << 20,
+        .stride = 64,
+        .elem = 8,
+        .tile = 8,
+        .store_frac = 0.0,
+        .zipf_s = 0.99,
+        .seed = 1,
+    };
+    const char *out = NULL;
+    bool have_pattern = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "hp:n:f:w:e:S:k:z:r:o:")) != -1) {
+        switch (c) {
+        case 'p':
+            for (size_t i = 0; i <= TILE; i++) {
+                if (strcmp(optarg, PATTERN_NAMES[i]) == 0) {
+                    p.pattern = (pattern_t)i;
+                    have_pattern = true;
+                }
+            }
+            break;
+        case 'n':
+            p.accesses = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            p.footprint = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            p.store_frac = atof(optarg);
+            break;
+        case 'e':
+            p.elem = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            p.stride = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            p.tile = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            p.zipf_s = atof(optarg);
+            break;
+        case 'r':
+            p.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (!have_pattern) {
+        printf("Error: Missing or unknown pattern\n");
+        usage(argv);
+        exit(1);
+    }
+    if (p.elem == 0 || p.stride == 0 || p.tile == 0 ||
+        p.footprint < p.elem || p.store_frac < 0.0 || p.store_frac > 1.0) {
+        printf("Error: Invalid pattern parameters\n");
+        usage(argv);
+        exit(1);
+    }
+
+    /* xorshift must not start from zero */
+    rng_state = p.seed != 0 ? p.seed : 1;
+
+    FILE *fp = stdout;
+    if (out != NULL && (fp = fopen(out, "w")) == NULL) {
+        printf("Error: Cannot open %s\n", out);
+        exit(1);
+    }
+
+    int status = generate(fp, &p);
+    if (status < 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+    }
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file trans-elem.c
+ * @brief Transpose kernels generated for several element types
+ *
+ * The kernels in trans.c only handle double. The ones here are generated by
+ * DEFINE_ELEM_KERNELS() for each element type in elem_type_t, with square
+ * tiles whose edge is the number of elements in one cache line, so a tile
+ * row of A and a tile column of B each cover whole lines whatever the
+ * element width. The tile edge is a compile-time constant, which lets the
+ * compiler fully unroll and vectorize the inner loops for each type.
+ *
+ * Like trans.c, this file can be compiled with TRANS_HOOKS, in which case
+ * every load and store is reported to transHookAccess() so that trans-tune
+ * can simulate each variant.
+ */
+
+#include <complex.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+/** @brief Cache line size the tiles are derived from, in bytes */
+#define ELEM_LINE_BYTES (1 << TEST_LOG_BLOCK)
+
+/** @brief Tile edge for an element type: elements per cache line */
+#define ELEM_TILE(type)                                                        \
+    (sizeof(type) < ELEM_LINE_BYTES ? ELEM_LINE_BYTES / sizeof(type) : 1)
+
+/* Element accessors, as in trans.c */
+#ifdef TRANS_HOOKS
+#define LD(x) (transHookAccess('L', &(x)), (x))
+#define ST(x, v) ((x) = (v), transHookAccess('S', &(x)))
+#else
+#define LD(x) (x)
+#define ST(x, v) ((x) = (v))
+#endif
+
+/**
+ * @brief Defines the kernels for one element type.
+ *
+ * Generates trans_<name>() (tiled transpose, with the partial tiles on the
+ * right and bottom edges handled by separate loops), correct_<name>() (the
+ * row-by-row reference) and init_<name>(), which fills A with values
+ * computed by the expression value from an int v returned by rand().
+ */
+#define DEFINE_ELEM_KERNELS(name, type, value)                                 \
+    static void trans_##name(size_t M, size_t N, const void *src,              \
+                             void *dst) {                                      \
+        const type(*A)[M] = (const type(*)[M])src;                             \
+        type(*B)[N] = dst;                                                     \
+        enum { T = ELEM_TILE(type) };                                          \
+        size_t M0 = M - M % T, N0 = N - N % T;                                 \
+        for (size_t r = 0; r < N0; r += T) {                                   \
+            for (size_t c = 0; c < M0; c += T) {                               \
+                for (size_t i = 0; i < T; i++) {                               \
+                    for (size_t j = 0; j < T; j++) {                           \
+                        ST(B[c + j][r + i], LD(A[r + i][c + j]));              \
+                    }                                                          \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        for (size_t r = 0; r < N; r++) {                                       \
+            for (size_t c = M0; c < M; c++) {                                  \
+                ST(B[c][r], LD(A[r][c]));                                      \
+            }                                                                  \
+        }                                                                      \
+        for (size_t r = N0; r < N; r++) {                                      \
+            for (size_t c = 0; c < M0; c++) {                                  \
+                ST(B[c][r], LD(A[r][c]));                                      \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void correct_##name(size_t M, size_t N, const void *src,            \
+                               void *dst) {                                    \
+        const type(*A)[M] = (const type(*)[M])src;                             \
+        type(*B)[N] = dst;                                                     \
+        for (size_t r = 0; r < N; r++) {                                       \
+            for (size_t c = 0; c < M; c++) {                                   \
+                ST(B[c][r], LD(A[r][c]));                                      \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void init_##name(size_t M, size_t N, void *dst) {                   \
+        type(*A)[M] = dst;                                                     \
+        for (size_t r = 0; r < N; r++) {                                       \
+            for (size_t c = 0; c < M; c++) {                                   \
+                int v = rand();                                                \
+                A[r][c] = (value);                                             \
+            }                                                                  \
+        }                                                                      \
+    }
+
+DEFINE_ELEM_KERNELS(double, double, (double)v / 8.0 + 1e10)
+DEFINE_ELEM_KERNELS(float, float, (float)v / 8.0f)
+DEFINE_ELEM_KERNELS(int32, int32_t, (int32_t)v)
+DEFINE_ELEM_KERNELS(int64, int64_t, (int64_t)v << 20 | v)
+DEFINE_ELEM_KERNELS(cdouble, double complex,
+                    (double)v + (double)v / 8.0 * I)
+
+/** @brief Table entry for the kernels generated for one element type */
+#define ELEM_ENTRY(name, type)                                                 \
+    {                                                                          \
+        #name, sizeof(type), ELEM_TILE(type), trans_##name, correct_##name,    \
+            init_##name                                                        \
+    }
+
+/** @brief Kernels for each element type, indexed by elem_type_t */
+const elem_kernels_t elemKernels[ELEM_NTYPES] = {
+    [ELEM_DOUBLE] = ELEM_ENTRY(double, double),
+    [ELEM_FLOAT] = ELEM_ENTRY(float, float),
+    [ELEM_INT32] = ELEM_ENTRY(int32, int32_t),
+    [ELEM_INT64] = ELEM_ENTRY(int64, int64_t),
+    [ELEM_CDOUBLE] = ELEM_ENTRY(cdouble, double complex),
+};
+
+/**
+ * @brief Looks up the kernels for an element type by name.
+ *
+ * @return The kernels, or NULL if there is no such element type
+ */
+const elem_kernels_t *findElemKernels(const char *name) {
+    for (int i = 0; i < ELEM_NTYPES; i++) {
+        if (strcmp(elemKernels[i].name, name) == 0) {
+            return &elemKernels[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,504 @@
+/**
+ * @file trans-file.c
+ * @brief Transposes a matrix stored in a file, which may not fit in memory
+ *
+ * The input file holds N rows of M doubles in row-major order, and the
+ * output file receives the M x N transpose. The input is processed in
+ * strips of W columns, where W is chosen so that a strip and its transpose
+ * fit in the memory budget. Each strip is gathered from the input with
+ * pread() or from an mmap() of it, transposed in memory with transTiled(),
+ * and written as one contiguous band of W output rows with large sequential
+ * writes. Writes are issued in units of the I/O granularity, and so are
+ * pread() reads, each covering the strip's part of as many consecutive rows
+ * as fit. In mmap mode, the kernel is told with posix_madvise() which rows
+ * will be read next, up to the granularity ahead, and which have been read.
+ */
+
+#define _XOPEN_SOURCE 700 // pread, pwrite, posix_madvise, clock_gettime
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cachelab.h"
+
+/** @brief Default memory budget for a strip and its transpose */
+#define DEFAULT_BUDGET (256UL << 20)
+
+/** @brief Default size of each read and write request */
+#define DEFAULT_GRANULARITY (1UL << 20)
+
+/** @brief Largest matrix that -v loads into memory to verify */
+#define MAX_VERIFY_BYTES (1UL << 30)
+
+/*
+ * In-memory tiling strategy, the one ./trans-tune -l -M 1024 -N 1024 picks
+ * for 1024x1024 on the Haswell L1.
+ */
+static const trans_params_t FILE_TILING = {8, 4, TILE_ROW_MAJOR, DIAG_DIRECT,
+                                           0};
+
+/** @brief Parameters of one file transpose */
+typedef struct {
+    size_t M;           /* columns of the input */
+    size_t N;           /* rows of the input */
+    size_t budget;      /* bytes available for a strip and its transpose */
+    size_t granularity; /* bytes per read or write request */
+    bool use_mmap;      /* gather strips from a mapping instead of pread */
+} file_params_t;
+
+/**
+ * @brief Returns the current monotonic time in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Reads exactly size bytes at offset, in granularity-sized requests.
+ *
+ * @return false on error or early end of file
+ */
+static bool read_full(int fd, void *buf, size_t size, off_t offset,
+                      size_t granularity) {
+    char *p = buf;
+    while (size > 0) {
+        size_t want = size < granularity ? size : granularity;
+        ssize_t got = pread(fd, p, want, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        p += got;
+        size -= (size_t)got;
+        offset += got;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes exactly size bytes at offset, in granularity-sized requests.
+ *
+ * @return false on error
+ */
+static bool write_full(int fd, const void *buf, size_t size, off_t offset,
+                       size_t granularity) {
+    const char *p = buf;
+    while (size > 0) {
+        size_t want = size < granularity ? size : granularity;
+        ssize_t put = pwrite(fd, p, want, offset);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        p += put;
+        size -= (size_t)put;
+        offset += put;
+    }
+    return true;
+}
+
+/**
+ * @brief Gives a posix_madvise() hint for the pages of the mapping that
+ * hold [offset, offset + size).
+ */
+static void advise(char *map, size_t map_size, size_t offset, size_t size,
+                   int advice) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    size_t end = offset + size < map_size ? offset + size : map_size;
+    if (start < end) {
+        (void)posix_madvise(map + start, end - start, advice);
+    }
+}
+
+/**
+ * @brief Tells the kernel that the pages of the mapping that lie wholly
+ * within [offset, offset + size) are no longer needed.
+ *
+ * Pages only partly in the range also hold columns of other strips, and
+ * are kept.
+ */
+static void release(char *map, size_t offset, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (offset + page - 1) / page * page;
+    size_t end = (offset + size) / page * page;
+    if (start < end) {
+        (void)posix_madvise(map + start, end - start, POSIX_MADV_DONTNEED);
+    }
+}
+
+/**
+ * @brief Returns how many rows of a strip of width columns one pread()
+ * request covers: as many as fit in the granularity, and at least one.
+ */
+static size_t rows_per_read(const file_params_t *p, size_t width) {
+    size_t row_bytes = p->M * sizeof(double);
+    size_t seg_bytes = width * sizeof(double);
+
+    if (p->granularity < row_bytes) {
+        return 1;
+    }
+    size_t rows = (p->granularity - seg_bytes) / row_bytes + 1;
+    return rows < p->N ? rows : p->N;
+}
+
+/**
+ * @brief Gathers columns [col, col + width) of every input row into strip.
+ *
+ * Each row holds a segment of the strip, row_bytes after that of the row
+ * before. With pread, when several rows fit in one request, the range from
+ * the first of their segments to the end of the last is read into stage,
+ * which holds granularity bytes, and the segments copied out of it; one
+ * segment is read straight into the strip otherwise. In mmap mode, the
+ * segments of the rows up to granularity bytes ahead are prefetched, and
+ * each segment is released once it has been copied.
+ *
+ * @return false on a read error
+ */
+static bool read_strip(const file_params_t *p, int fd, char *map, char *stage,
+                       double *strip, size_t col, size_t width) {
+    size_t row_bytes = p->M * sizeof(double);
+    size_t seg_bytes = width * sizeof(double);
+    size_t map_size = p->N * row_bytes;
+
+    if (map == NULL && width == p->M) {
+        /* Whole rows: the strip is one contiguous range of the file */
+        return read_full(fd, strip, p->N * row_bytes, 0, p->granularity);
+    }
+
+    if (map == NULL) {
+        size_t rows = rows_per_read(p, width);
+        for (size_t r = 0; r < p->N; r += rows) {
+            size_t n = p->N - r < rows ? p->N - r : rows;
+            size_t offset = r * row_bytes + col * sizeof(double);
+            if (n == 1) {
+                if (!read_full(fd, &strip[r * width], seg_bytes,
+                               (off_t)offset, p->granularity)) {
+                    return false;
+                }
+                continue;
+            }
+            size_t span = (n - 1) * row_bytes + seg_bytes;
+            if (!read_full(fd, stage, span, (off_t)offset, span)) {
+                return false;
+            }
+            for (size_t i = 0; i < n; i++) {
+                memcpy(&strip[(r + i) * width], stage + i * row_bytes,
+                       seg_bytes);
+            }
+        }
+        return true;
+    }
+
+    size_t ahead = p->granularity / seg_bytes;
+    size_t advised = 0; /* rows whose segment has been prefetched */
+    for (size_t r = 0; r < p->N; r++) {
+        size_t offset = r * row_bytes + col * sizeof(double);
+        for (; advised < p->N && advised <= r + ahead; advised++) {
+            advise(map, map_size, advised * row_bytes + col * sizeof(double),
+                   seg_bytes, POSIX_MADV_WILLNEED);
+        }
+        memcpy(&strip[r * width], map + offset, seg_bytes);
+        release(map, offset, seg_bytes);
+    }
+    return true;
+}
+
+/**
+ * @brief Transposes the input file into the output file.
+ *
+ * @return false on an I/O error or if out of memory
+ */
+static bool transpose_file(const file_params_t *p, int in_fd, int out_fd) {
+    size_t M = p->M, N = p->N;
+    size_t file_bytes = M * N * sizeof(double);
+
+    /* Strip width: a strip and its transpose must fit in the budget */
+    size_t width = p->budget / (2 * N * sizeof(double));
+    if (width >= 8) {
+        width -= width % 8; /* keep bands a whole number of tiles */
+    }
+    width = width == 0 ? 1 : width > M ? M : width;
+
+    double *strip = malloc(N * width * sizeof(double));
+    double *band = malloc(N * width * sizeof(double));
+    double *tmp = calloc(TMPCOUNT, sizeof(double));
+    char *map = NULL;
+    char *stage = NULL;
+    bool ok = strip != NULL && band != NULL && tmp != NULL;
+
+    if (ok && p->use_mmap) {
+        void *addr = mmap(NULL, file_bytes, PROT_READ, MAP_SHARED, in_fd, 0);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "Error: mmap failed: %s\n", strerror(errno));
+            ok = false;
+        } else {
+            map = addr;
+            (void)posix_madvise(map, file_bytes, width == M
+                                                     ? POSIX_MADV_SEQUENTIAL
+                                                     : POSIX_MADV_NORMAL);
+        }
+    }
+
+    /* Requests of several rows, for this or the narrower last strip */
+    size_t rows = rows_per_read(p, width);
+    if (ok && map == NULL && width < M &&
+        p->granularity >= M * sizeof(double)) {
+        stage = malloc(p->granularity);
+        ok = stage != NULL;
+    }
+
+    printf("Strips of %zu columns (%zu strips), ", width,
+           (M + width - 1) / width);
+    if (map != NULL) {
+        printf("mmap reads %zu bytes ahead", p->granularity);
+    } else if (width == M) {
+        printf("%zu-byte pread reads", p->granularity);
+    } else {
+        size_t seg_bytes = width * sizeof(double);
+        size_t span = (rows - 1) * M * sizeof(double) + seg_bytes;
+        printf("%zu-byte pread reads of %zu row(s)",
+               span < p->granularity ? span : p->granularity, rows);
+    }
+    printf(", %zu-byte writes\n", p->granularity);
+
+    for (size_t col = 0; col < M && ok; col += width) {
+        size_t w = col + width < M ? width : M - col;
+        ok = read_strip(p, in_fd, map, stage, strip, col, w);
+        if (!ok) {
+            fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+            break;
+        }
+
+        /* The strip is an N x w matrix; its transpose is w rows of output */
+        transTiled(w, N, (double(*)[w])strip, (double(*)[N])band, tmp,
+                   &FILE_TILING);
+
+        ok = write_full(out_fd, band, w * N * sizeof(double),
+                        (off_t)(col * N * sizeof(double)), p->granularity);
+        if (!ok) {
+            fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+        }
+    }
+
+    if (map != NULL) {
+        munmap(map, file_bytes);
+    }
+    free(strip);
+    free(band);
+    free(tmp);
+    free(stage);
+    return ok;
+}
+
+/**
+ * @brief Writes an N x M matrix of random doubles to fd, a row at a time.
+ *
+ * @return false on a write error or if out of memory
+ */
+static bool create_input(int fd, size_t M, size_t N, size_t granularity) {
+    double *row = malloc(M * sizeof(double));
+    bool ok = row != NULL;
+
+    srand(1);
+    for (size_t r = 0; r < N && ok; r++) {
+        for (size_t c = 0; c < M; c++) {
+            /* Same kind of data as initMatrix() */
+            row[c] = (double)rand() / 8.0 + 1e10;
+        }
+        ok = write_full(fd, row, M * sizeof(double),
+                        (off_t)(r * M * sizeof(double)), granularity);
+    }
+    free(row);
+    return ok;
+}
+
+/**
+ * @brief Checks the output file against correctTrans() of the input.
+ *
+ * @return false if the output is wrong or cannot be checked
+ */
+static bool verify(int in_fd, int out_fd, size_t M, size_t N) {
+    size_t bytes = M * N * sizeof(double);
+    if (bytes > MAX_VERIFY_BYTES) {
+        printf("Matrix too large to verify in memory\n");
+        return false;
+    }
+
+    double(*A)[N][M] = malloc(bytes);
+    double(*B)[M][N] = malloc(bytes);
+    double(*Bref)[M][N] = malloc(bytes);
+    bool ok = A != NULL && B != NULL && Bref != NULL &&
+              read_full(in_fd, A, bytes, 0, DEFAULT_GRANULARITY) &&
+              read_full(out_fd, B, bytes, 0, DEFAULT_GRANULARITY);
+
+    if (ok) {
+        correctTrans(M, N, *A, *Bref);
+        ok = memcmp(B, Bref, bytes) == 0;
+    }
+    free(A);
+    free(B);
+    free(Bref);
+    return ok;
+}
+
+/**
+ * @brief Parses a byte count with an optional K, M or G suffix.
+ *
+ * @return The count, or 0 if malformed
+ */
+static size_t parse_bytes(const char *arg) {
+    char *end;
+    unsigned long long val = strtoull(arg, &end, 0);
+    switch (*end) {
+    case 'G':
+        val <<= 10; // fall through
+    case 'M':
+        val <<= 10; // fall through
+    case 'K':
+        val <<= 10;
+        end++;
+        break;
+    default:
+        break;
+    }
+    return end == arg || *end != '\0' ? 0 : (size_t)val;
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-hcv] [-m] [-b <bytes>] [-g <bytes>] -M <cols> "
+           "-N <rows> -i <in> -o <out>\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -c          First create <in> with random data\n");
+    printf("  -v          Verify <out> against correctTrans (if it fits)\n");
+    printf("  -m          Read strips through mmap instead of pread\n");
+    printf("  -b <bytes>  Memory budget for a strip (default 256M)\n");
+    printf("  -g <bytes>  Size of each read and write request (default 1M)\n");
+    printf("  -M <cols>   Number of columns of the input\n");
+    printf("  -N <rows>   Number of rows of the input\n");
+    printf("  -i <in>     Input file of N x M doubles, row-major\n");
+    printf("  -o <out>    Output file for the M x N transpose\n");
+    printf("Example: %s -c -v -M 4096 -N 4096 -i A.bin -o B.bin\n", argv[0]);
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    file_params_t p = {0, 0, DEFAULT_BUDGET, DEFAULT_GRANULARITY, false};
+    const char *in = NULL, *out = NULL;
+    bool create = false, check = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "hcvmb:g:M:N:i:o:")) != -1) {
+        switch (c) {
+        case 'c':
+            create = true;
+            break;
+        case 'v':
+            check = true;
+            break;
+        case 'm':
+            p.use_mmap = true;
+            break;
+        case 'b':
+            p.budget = parse_bytes(optarg);
+            break;
+        case 'g':
+            p.granularity = parse_bytes(optarg);
+            break;
+        case 'M':
+            p.M = (size_t)strtoull(optarg, NULL, 0);
+            break;
+        case 'N':
+            p.N = (size_t)strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            in = optarg;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (p.M == 0 || p.N == 0 || in == NULL || out == NULL) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+    if (p.budget == 0 || p.granularity == 0) {
+        printf("Error: Invalid budget or granularity\n");
+        usage(argv);
+        exit(1);
+    }
+
+    size_t file_bytes = p.M * p.N * sizeof(double);
+    int in_fd = open(in, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    if (in_fd < 0) {
+        printf("Error: Cannot open %s: %s\n", in, strerror(errno));
+        exit(1);
+    }
+    if (create && !create_input(in_fd, p.M, p.N, p.granularity)) {
+        printf("Error: Cannot write %s: %s\n", in, strerror(errno));
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(in_fd, &st) < 0 || (size_t)st.st_size != file_bytes) {
+        printf("Error: %s does not hold %zu x %zu doubles\n", in, p.N, p.M);
+        exit(1);
+    }
+
+    int out_fd = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        printf("Error: Cannot open %s: %s\n", out, strerror(errno));
+        exit(1);
+    }
+
+    double start = now();
+    bool ok = transpose_file(&p, in_fd, out_fd) && fsync(out_fd) == 0;
+    double secs = now() - start;
+
+    if (ok) {
+        double mb = (double)file_bytes / (1 << 20);
+        printf("Transposed %.1f MB in %.3f s: %.1f MB/s\n", mb, secs,
+               mb / secs);
+    }
+
+    if (ok && check) {
+        ok = verify(in_fd, out_fd, p.M, p.N);
+        printf("Verification against correctTrans: %s\n",
+               ok ? "Correct" : "FAILED");
+    }
+
+    close(in_fd);
+    close(out_fd);
+    return ok ? 0 : 1;
+}
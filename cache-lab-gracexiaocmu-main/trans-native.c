@@ -0,0 +1,420 @@
+/**
+ * @file trans-native.c
+ * @brief Transpose functions tuned for running natively on x86 hardware
+ *
+ * Unlike trans.c, these functions are written for wall-clock speed rather
+ * than for the simulated cache, and they are free to keep data in vector
+ * registers. They are not part of the handin, and test-trans only times
+ * them natively (-w), since tracegen-ct cannot trace vector accesses.
+ *
+ * The AVX2 kernel is only registered when the CPU supports it. The parallel
+ * kernel splits the work across a pool of threads, whose size is set with
+ * transSetThreads(). The streaming kernel writes B with non-temporal stores,
+ * which skip the read-for-ownership of each destination line.
+ */
+
+#define _XOPEN_SOURCE 700 // sysconf
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "cachelab.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANS_X86 1
+#endif
+
+/** @brief Edge of the cache blocks walked by the SIMD kernels */
+#define NATIVE_BLOCK 32
+
+/** @brief Maximum number of threads used by the parallel kernel */
+#define MAX_THREADS 64
+
+/**
+ * @brief Size of B above which trans_native_auto uses streaming stores.
+ *
+ * Roughly the size of a last-level cache: below it, B is likely to still
+ * be cached when it is next read, and streaming it out would only hurt.
+ */
+#ifndef NATIVE_STREAM_BYTES
+#define NATIVE_STREAM_BYTES (16UL << 20)
+#endif
+
+/**
+ * @brief Transposes the part of A not covered by the 4x4 micro-kernels.
+ *
+ * The kernels handle rows [0, N4) and columns [0, M4), where N4 and M4 are
+ * N and M rounded down to a multiple of 4; this copies the rest.
+ */
+static void trans_edges(size_t M, size_t N, double A[N][M], double B[M][N],
+                        size_t M4, size_t N4) {
+    for (size_t r = 0; r < N4; r++) {
+        for (size_t c = M4; c < M; c++) {
+            B[c][r] = A[r][c];
+        }
+    }
+    for (size_t r = N4; r < N; r++) {
+        for (size_t c = 0; c < M; c++) {
+            B[c][r] = A[r][c];
+        }
+    }
+}
+
+/**
+ * @brief Transposes rows [row, row_end) and columns [col, col_end) of A.
+ *
+ * All bounds must be multiples of 4. On x86 each 4x4 block is transposed
+ * in registers with SSE2: each of its rows is held in two 128-bit
+ * registers, and the four 2x2 sub-blocks are transposed with
+ * unpacklo/unpackhi.
+ */
+static void trans_block(size_t M, size_t N, double A[N][M], double B[M][N],
+                        size_t row, size_t row_end, size_t col,
+                        size_t col_end) {
+#ifdef TRANS_X86
+    for (size_t r = row; r < row_end; r += 4) {
+        for (size_t c = col; c < col_end; c += 4) {
+            __m128d a0 = _mm_loadu_pd(&A[r][c]);
+            __m128d a1 = _mm_loadu_pd(&A[r + 1][c]);
+            __m128d a2 = _mm_loadu_pd(&A[r + 2][c]);
+            __m128d a3 = _mm_loadu_pd(&A[r + 3][c]);
+            __m128d b0 = _mm_loadu_pd(&A[r][c + 2]);
+            __m128d b1 = _mm_loadu_pd(&A[r + 1][c + 2]);
+            __m128d b2 = _mm_loadu_pd(&A[r + 2][c + 2]);
+            __m128d b3 = _mm_loadu_pd(&A[r + 3][c + 2]);
+            _mm_storeu_pd(&B[c][r], _mm_unpacklo_pd(a0, a1));
+            _mm_storeu_pd(&B[c][r + 2], _mm_unpacklo_pd(a2, a3));
+            _mm_storeu_pd(&B[c + 1][r], _mm_unpackhi_pd(a0, a1));
+            _mm_storeu_pd(&B[c + 1][r + 2], _mm_unpackhi_pd(a2, a3));
+            _mm_storeu_pd(&B[c + 2][r], _mm_unpacklo_pd(b0, b1));
+            _mm_storeu_pd(&B[c + 2][r + 2], _mm_unpacklo_pd(b2, b3));
+            _mm_storeu_pd(&B[c + 3][r], _mm_unpackhi_pd(b0, b1));
+            _mm_storeu_pd(&B[c + 3][r + 2], _mm_unpackhi_pd(b2, b3));
+        }
+    }
+#else
+    for (size_t r = row; r < row_end; r++) {
+        for (size_t c = col; c < col_end; c++) {
+            B[c][r] = A[r][c];
+        }
+    }
+#endif
+}
+
+#ifdef TRANS_X86
+/**
+ * @brief Transposes with 4x4 in-register blocks using SSE2.
+ */
+static void trans_sse2(size_t M, size_t N, double A[N][M], double B[M][N],
+                       double *tmp) {
+    size_t M4 = M & ~(size_t)3;
+    size_t N4 = N & ~(size_t)3;
+
+    for (size_t row = 0; row < N4; row += NATIVE_BLOCK) {
+        size_t row_end = row + NATIVE_BLOCK < N4 ? row + NATIVE_BLOCK : N4;
+        for (size_t col = 0; col < M4; col += NATIVE_BLOCK) {
+            size_t col_end = col + NATIVE_BLOCK < M4 ? col + NATIVE_BLOCK : M4;
+            trans_block(M, N, A, B, row, row_end, col, col_end);
+        }
+    }
+    trans_edges(M, N, A, B, M4, N4);
+}
+
+/**
+ * @brief Transposes with non-temporal stores of whole lines of B.
+ *
+ * Eight rows of A are walked together, four columns at a time, so each
+ * column yields the eight doubles of one 64-byte line of B, written with
+ * _mm_stream_pd, bypassing the cache. That only holds when B starts on a
+ * line and its rows are a whole number of lines long; otherwise the stores
+ * would leave partial lines in the write-combining buffers, so this falls
+ * back to trans_sse2.
+ */
+static void trans_stream(size_t M, size_t N, double A[N][M], double B[M][N],
+                         double *tmp) {
+    if (((uintptr_t)B & 63) != 0 || (N * sizeof(double)) % 64 != 0) {
+        trans_sse2(M, N, A, B, tmp);
+        return;
+    }
+
+    size_t M4 = M & ~(size_t)3;
+    size_t N8 = N & ~(size_t)7;
+
+    for (size_t r = 0; r < N8; r += 8) {
+        for (size_t c = 0; c < M4; c += 4) {
+            __m128d lo[8], hi[8];
+            for (size_t k = 0; k < 8; k++) {
+                lo[k] = _mm_loadu_pd(&A[r + k][c]);
+                hi[k] = _mm_loadu_pd(&A[r + k][c + 2]);
+            }
+            for (size_t j = 0; j < 4; j++) {
+                const __m128d *src = j < 2 ? lo : hi;
+                double *dst = &B[c + j][r];
+                for (size_t k = 0; k < 8; k += 2) {
+                    __m128d pair = j % 2 == 0
+                                       ? _mm_unpacklo_pd(src[k], src[k + 1])
+                                       : _mm_unpackhi_pd(src[k], src[k + 1]);
+                    _mm_stream_pd(dst + k, pair);
+                }
+            }
+        }
+    }
+    /* Order the streaming stores before any later access to B */
+    _mm_sfence();
+
+    trans_edges(M, N, A, B, M4, N8);
+}
+
+/**
+ * @brief Picks streaming stores for large B and cached stores otherwise.
+ */
+static void trans_native_auto(size_t M, size_t N, double A[N][M],
+                              double B[M][N], double *tmp) {
+    if (M * N * sizeof(double) >= NATIVE_STREAM_BYTES) {
+        trans_stream(M, N, A, B, tmp);
+    } else {
+        trans_sse2(M, N, A, B, tmp);
+    }
+}
+
+/**
+ * @brief Transposes with 4x4 in-register blocks using AVX2.
+ *
+ * Each row of a 4x4 block is one 256-bit register. unpacklo/unpackhi
+ * transpose the 2x2 sub-blocks within each 128-bit lane; permute4x64 then
+ * swaps the lanes of one register of each pair, and a blend joins its
+ * off-diagonal sub-block with the other.
+ */
+__attribute__((target("avx2"))) static void
+trans_avx2(size_t M, size_t N, double A[N][M], double B[M][N], double *tmp) {
+    size_t M4 = M & ~(size_t)3;
+    size_t N4 = N & ~(size_t)3;
+
+    for (size_t row = 0; row < N4; row += NATIVE_BLOCK) {
+        size_t row_end = row + NATIVE_BLOCK < N4 ? row + NATIVE_BLOCK : N4;
+        for (size_t col = 0; col < M4; col += NATIVE_BLOCK) {
+            size_t col_end = col + NATIVE_BLOCK < M4 ? col + NATIVE_BLOCK : M4;
+            for (size_t r = row; r < row_end; r += 4) {
+                for (size_t c = col; c < col_end; c += 4) {
+                    __m256d a0 = _mm256_loadu_pd(&A[r][c]);
+                    __m256d a1 = _mm256_loadu_pd(&A[r + 1][c]);
+                    __m256d a2 = _mm256_loadu_pd(&A[r + 2][c]);
+                    __m256d a3 = _mm256_loadu_pd(&A[r + 3][c]);
+                    __m256d t0 = _mm256_unpacklo_pd(a0, a1);
+                    __m256d t1 = _mm256_unpackhi_pd(a0, a1);
+                    __m256d t2 = _mm256_unpacklo_pd(a2, a3);
+                    __m256d t3 = _mm256_unpackhi_pd(a2, a3);
+                    __m256d s0 = _mm256_permute4x64_pd(t0, 0x4e);
+                    __m256d s1 = _mm256_permute4x64_pd(t1, 0x4e);
+                    __m256d s2 = _mm256_permute4x64_pd(t2, 0x4e);
+                    __m256d s3 = _mm256_permute4x64_pd(t3, 0x4e);
+                    _mm256_storeu_pd(&B[c][r], _mm256_blend_pd(t0, s2, 0xc));
+                    _mm256_storeu_pd(&B[c + 1][r],
+                                     _mm256_blend_pd(t1, s3, 0xc));
+                    _mm256_storeu_pd(&B[c + 2][r],
+                                     _mm256_blend_pd(s0, t2, 0xc));
+                    _mm256_storeu_pd(&B[c + 3][r],
+                                     _mm256_blend_pd(s1, t3, 0xc));
+                }
+            }
+        }
+    }
+    trans_edges(M, N, A, B, M4, N4);
+}
+#endif /* TRANS_X86 */
+
+/** @brief Threads used by trans_parallel, 0 for one per online CPU */
+static int native_threads = 0;
+
+/**
+ * @brief Sets the number of threads used by the parallel transpose.
+ *
+ * @param[in] threads Thread count, or 0 for one per online CPU
+ */
+void transSetThreads(int threads) {
+    native_threads = threads < 0 ? 0 : threads;
+}
+
+/**
+ * @brief Returns the number of threads used by the parallel transpose.
+ */
+int transGetThreads(void) {
+    int threads = native_threads;
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    return threads < MAX_THREADS ? threads : MAX_THREADS;
+}
+
+/**
+ * @brief Work shared by the threads of one parallel transpose.
+ *
+ * The columns [0, M4) of A are cut into bands NATIVE_BLOCK wide, which
+ * threads claim one at a time. A band of columns of A is a band of whole
+ * rows of B, so threads never write to the same line of B except where
+ * one row of B ends and the next begins.
+ */
+typedef struct {
+    size_t M;
+    size_t N;
+    double *A;
+    double *B;
+    size_t bands; /* number of column bands */
+    size_t next;  /* next band to claim, updated atomically */
+} par_job_t;
+
+/**
+ * @brief Transposes column bands of the job until none are left.
+ */
+static void par_work(par_job_t *job) {
+    size_t M = job->M, N = job->N;
+    double(*A)[M] = (double(*)[M])job->A;
+    double(*B)[N] = (double(*)[N])job->B;
+    size_t M4 = M & ~(size_t)3;
+    size_t N4 = N & ~(size_t)3;
+    size_t band;
+
+    while ((band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->bands) {
+        size_t col = band * NATIVE_BLOCK;
+        size_t col_end = col + NATIVE_BLOCK < M4 ? col + NATIVE_BLOCK : M4;
+        for (size_t row = 0; row < N4; row += NATIVE_BLOCK) {
+            size_t row_end = row + NATIVE_BLOCK < N4 ? row + NATIVE_BLOCK : N4;
+            trans_block(M, N, A, B, row, row_end, col, col_end);
+        }
+        for (size_t r = N4; r < N; r++) {
+            for (size_t c = col; c < col_end; c++) {
+                B[c][r] = A[r][c];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Pool of helper threads, created on demand and kept for reuse.
+ *
+ * The calling thread posts a job by bumping the generation, works on it
+ * alongside the first `helpers` helper threads, and waits for them.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start; /* signalled when a job is posted */
+    pthread_cond_t done;  /* signalled when the last helper finishes */
+    int created;          /* helper threads created so far */
+    int helpers;          /* helpers taking part in the current job */
+    int running;          /* helpers still working on the current job */
+    unsigned long generation;        /* number of jobs posted */
+    unsigned long seen[MAX_THREADS]; /* generation each helper started at */
+    par_job_t *job;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+          .start = PTHREAD_COND_INITIALIZER,
+          .done = PTHREAD_COND_INITIALIZER};
+
+/**
+ * @brief Main loop of a helper thread.
+ */
+static void *pool_helper(void *arg) {
+    int id = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    unsigned long seen = pool.seen[id];
+    for (;;) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        seen = pool.generation;
+        if (id < pool.helpers) {
+            pthread_mutex_unlock(&pool.lock);
+            par_work(pool.job);
+            pthread_mutex_lock(&pool.lock);
+            if (--pool.running == 0) {
+                pthread_cond_signal(&pool.done);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs a job on the calling thread and up to threads - 1 helpers.
+ */
+static void pool_run(par_job_t *job, int threads) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.created < threads - 1) {
+        pthread_t tid;
+        pool.seen[pool.created] = pool.generation;
+        if (pthread_create(&tid, NULL, pool_helper,
+                           (void *)(intptr_t)pool.created) != 0) {
+            break;
+        }
+        pthread_detach(tid);
+        pool.created++;
+    }
+    pool.job = job;
+    pool.helpers = pool.created < threads - 1 ? pool.created : threads - 1;
+    pool.running = pool.helpers;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    par_work(job);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Tiled transpose split across transGetThreads() threads.
+ *
+ * With one thread no helper is involved, and every element is copied
+ * exactly once either way, so the result does not depend on the count.
+ */
+static void trans_parallel(size_t M, size_t N, double A[N][M], double B[M][N],
+                           double *tmp) {
+    size_t M4 = M & ~(size_t)3;
+    par_job_t job = {M, N, &A[0][0], &B[0][0],
+                     (M4 + NATIVE_BLOCK - 1) / NATIVE_BLOCK, 0};
+
+    int threads = transGetThreads();
+    if ((size_t)threads > job.bands) {
+        threads = (int)job.bands;
+    }
+    if (threads > 1) {
+        pool_run(&job, threads);
+    } else {
+        par_work(&job);
+    }
+
+    /* Columns left over when M is not a multiple of 4 */
+    for (size_t r = 0; r < N; r++) {
+        for (size_t c = M4; c < M; c++) {
+            B[c][r] = A[r][c];
+        }
+    }
+}
+
+/**
+ * @brief Registers the native transpose functions with the driver.
+ *
+ * Called after registerFunctions(), so the functions in trans.c keep their
+ * indices. Kernels the CPU cannot run are left out.
+ */
+void registerNativeFunctions(void) {
+    registerTransFunction(trans_parallel, PARALLEL_DESCRIPTION);
+#ifdef TRANS_X86
+    registerTransFunction(trans_sse2, "SSE2 4x4 micro-kernel");
+    registerTransFunction(trans_stream, "SSE2 streaming stores");
+    registerTransFunction(trans_native_auto,
+                          "Streaming stores above NATIVE_STREAM_BYTES");
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        registerTransFunction(trans_avx2, "AVX2 4x4 micro-kernel");
+    }
+#endif
+}
@@ -0,0 +1,592 @@
+/**
+ * @file trans-tune.c
+ * @brief Searches for the best tiling strategy for each transpose shape
+ *
+ * This program links against a build of trans.c with TRANS_HOOKS defined,
+ * so every load and store made by transTiled() is fed to a small LRU cache
+ * simulator running in the same process. For each matrix shape it tries
+ * every combination of tile size, tile traversal order, diagonal handling
+ * and tmp staging depth, checks that the result is correct, and ranks the
+ * candidates by the cycle count used for grading.
+ *
+ * The best strategy for each shape is printed as a row of the TUNED table
+ * in trans.c, which transpose_submit() dispatches on.
+ */
+
+#define _XOPEN_SOURCE 600 // posix_memalign
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+#define MAX_STR 1024 /* Max string size */
+
+/** @brief Matrix shapes tuned by default, the same ones the driver tests */
+static const size_t SHAPES[][2] = {
+    {1, 1},   {7, 2},   {3, 15},   {137, 1},  {6, 60},      {57, 57},
+    {128, 128}, {32, 32}, {64, 64}, {63, 65}, {1024, 1024},
+};
+
+#define NSHAPES (sizeof(SHAPES) / sizeof(SHAPES[0]))
+
+/** @brief Shapes used to compare the recursive transpose, up to MAXN */
+static const size_t REC_SHAPES[][2] = {
+    {16, 16},     {31, 31},     {32, 32},     {57, 57},   {61, 67},
+    {64, 64},     {100, 100},   {128, 128},   {255, 257}, {256, 256},
+    {512, 512},   {1000, 1000}, {1024, 1024}, {2048, 2048},
+    {4096, 4096}, {4096, 17},   {17, 4096},
+};
+
+#define NREC_SHAPES (sizeof(REC_SHAPES) / sizeof(REC_SHAPES[0]))
+
+/** @brief Tile edges tried for both dimensions */
+static const size_t TILE_EDGES[] = {2, 4, 8, 16, 32};
+
+#define NEDGES (sizeof(TILE_EDGES) / sizeof(TILE_EDGES[0]))
+
+/** @brief Upper bound on the size of the search space */
+#define MAX_CANDS 4096
+
+/*
+ * Simulated addresses of A, tmp and B. They follow the layout of bigA,
+ * bigT and bigB in tracegen-ct, so conflicts between the three arrays are
+ * the same as in the graded traces.
+ */
+#define SIM_A_BASE 0UL
+#define SIM_T_BASE (SIM_A_BASE + sizeof(double) * MAXN * MAXN)
+#define SIM_B_BASE (SIM_T_BASE + sizeof(double) * TMPCOUNT)
+
+/** @brief State of the in-process cache simulator */
+static struct {
+    int s;
+    int E;
+    int b;
+    unsigned long *tags;   /* tag of each line, sets laid out in order */
+    unsigned long *stamps; /* last use of each line, 0 if invalid */
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    /* Address ranges of the matrices being transposed */
+    const char *a;
+    const char *t;
+    const char *b_mat;
+    size_t a_size;
+    size_t b_size;
+    bool bad_access; /* an access fell outside A, tmp and B */
+} sim;
+
+/**
+ * @brief Maps a real address to its simulated address.
+ */
+static bool sim_address(const void *addr, unsigned long *out) {
+    const char *p = addr;
+    if (p >= sim.a && p < sim.a + sim.a_size) {
+        *out = SIM_A_BASE + (unsigned long)(p - sim.a);
+    } else if (p >= sim.t && p < sim.t + sizeof(double) * TMPCOUNT) {
+        *out = SIM_T_BASE + (unsigned long)(p - sim.t);
+    } else if (p >= sim.b_mat && p < sim.b_mat + sim.b_size) {
+        *out = SIM_B_BASE + (unsigned long)(p - sim.b_mat);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Simulates one access by a hooked kernel in trans.c.
+ *
+ * Loads and stores behave the same under write-allocate, so op is unused.
+ */
+void transHookAccess(char op, const void *addr) {
+    unsigned long address;
+    if (!sim_address(addr, &address)) {
+        sim.bad_access = true;
+        return;
+    }
+
+    unsigned long block = address >> sim.b;
+    unsigned long set = block & ((1UL << sim.s) - 1);
+    unsigned long tag = block >> sim.s;
+    unsigned long *tags = &sim.tags[set * (unsigned long)sim.E];
+    unsigned long *stamps = &sim.stamps[set * (unsigned long)sim.E];
+
+    sim.clock++;
+    size_t victim = 0;
+    for (size_t i = 0; i < (size_t)sim.E; i++) {
+        if (stamps[i] != 0 && tags[i] == tag) {
+            stamps[i] = sim.clock;
+            sim.hits++;
+            return;
+        }
+        if (stamps[i] < stamps[victim]) {
+            victim = i;
+        }
+    }
+
+    sim.misses++;
+    if (stamps[victim] != 0) {
+        sim.evictions++;
+    }
+    tags[victim] = tag;
+    stamps[victim] = sim.clock;
+}
+
+/**
+ * @brief Empties the simulated cache and clears its counters.
+ */
+static void sim_reset(void) {
+    size_t lines = ((size_t)1 << sim.s) * (size_t)sim.E;
+    memset(sim.stamps, 0, lines * sizeof(unsigned long));
+    sim.clock = 0;
+    sim.hits = 0;
+    sim.misses = 0;
+    sim.evictions = 0;
+    sim.bad_access = false;
+}
+
+/** @brief A candidate strategy together with its simulated cost */
+typedef struct {
+    trans_params_t params;
+    size_t leaf; /* if nonzero, run transRecursive() with this leaf */
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long cycles;
+} candidate_t;
+
+/**
+ * @brief Fills cands with every strategy in the search space.
+ *
+ * @return The number of candidates, at most max
+ */
+static size_t enumerate(candidate_t *cands, size_t max) {
+    static const tile_order_t orders[] = {TILE_ROW_MAJOR, TILE_COL_MAJOR};
+    static const diag_mode_t diags[] = {DIAG_DIRECT, DIAG_DEFER, DIAG_STAGE,
+                                        DIAG_STAGE_ALL};
+    size_t n = 0;
+
+    for (size_t i = 0; i < NEDGES; i++) {
+        for (size_t j = 0; j < NEDGES; j++) {
+            for (size_t o = 0; o < 2; o++) {
+                for (size_t d = 0; d < 4; d++) {
+                    size_t th = TILE_EDGES[i], tw = TILE_EDGES[j];
+                    trans_params_t p = {th, tw, orders[o], diags[d], 0};
+                    if (diags[d] < DIAG_STAGE) {
+                        /* Staging depth only matters when staging */
+                        if (n < max) {
+                            cands[n++].params = p;
+                        }
+                        continue;
+                    }
+                    for (p.stage_rows = 1;
+                         p.stage_rows <= th && p.stage_rows * tw <= TMPCOUNT;
+                         p.stage_rows *= 2) {
+                        if (n < max) {
+                            cands[n++].params = p;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/** @brief Matrices shared by all candidates for one shape */
+typedef struct {
+    void *A;    /* source, N rows of M */
+    void *B;    /* destination, M rows of N */
+    void *Bref; /* expected destination */
+    double *tmp;
+} mats_t;
+
+/**
+ * @brief Allocates aligned memory, returning NULL on failure
+ */
+static void *aligned_malloc(size_t size) {
+    void *ptr;
+    return posix_memalign(&ptr, 64, size) == 0 ? ptr : NULL;
+}
+
+/**
+ * @brief Frees the matrices of one shape.
+ */
+static void mats_free(mats_t *m) {
+    free(m->A);
+    free(m->B);
+    free(m->Bref);
+    free(m->tmp);
+}
+
+/**
+ * @brief Allocates and fills the matrices of one shape, and points the
+ * simulator at them.
+ *
+ * @return false if out of memory
+ */
+static bool mats_alloc(mats_t *m, size_t M, size_t N) {
+    size_t bytes = sizeof(double) * M * N;
+    m->A = aligned_malloc(bytes);
+    m->B = aligned_malloc(bytes);
+    m->Bref = malloc(bytes);
+    m->tmp = aligned_malloc(sizeof(double) * TMPCOUNT);
+    if (m->A == NULL || m->B == NULL || m->Bref == NULL || m->tmp == NULL) {
+        mats_free(m);
+        return false;
+    }
+
+    initMatrix(M, N, m->A, m->B);
+    correctTrans(M, N, m->A, m->Bref);
+    sim.a = m->A;
+    sim.a_size = bytes;
+    sim.b_mat = m->B;
+    sim.b_size = bytes;
+    sim.t = (const char *)m->tmp;
+    return true;
+}
+
+/**
+ * @brief Runs one candidate on the given matrices and records its cost.
+ *
+ * @return false if the candidate produced a wrong result or touched memory
+ *         outside the matrices
+ */
+static bool evaluate(candidate_t *cand, size_t M, size_t N, const mats_t *m) {
+    memset(m->B, 0, sizeof(double) * M * N);
+    memset(m->tmp, 0, sizeof(double) * TMPCOUNT);
+    sim_reset();
+
+    if (cand->leaf != 0) {
+        transRecursive(M, N, m->A, m->B, m->tmp, cand->leaf);
+    } else {
+        transTiled(M, N, m->A, m->B, m->tmp, &cand->params);
+    }
+
+    if (sim.bad_access ||
+        memcmp(m->B, m->Bref, sizeof(double) * M * N) != 0) {
+        return false;
+    }
+    cand->hits = sim.hits;
+    cand->misses = sim.misses;
+    cand->cycles = HIT_CYCLES * sim.hits + MISS_CYCLES * sim.misses;
+    return true;
+}
+
+/**
+ * @brief Orders candidates by cycles, then by smaller tiles for stability.
+ */
+static int compare_cands(const void *x, const void *y) {
+    const candidate_t *a = x, *b = y;
+    if (a->cycles != b->cycles) {
+        return a->cycles < b->cycles ? -1 : 1;
+    }
+    size_t area_a = a->params.tile_rows * a->params.tile_cols;
+    size_t area_b = b->params.tile_rows * b->params.tile_cols;
+    return area_a < area_b ? -1 : area_a > area_b;
+}
+
+static const char *ORDER_NAMES[] = {"TILE_ROW_MAJOR", "TILE_COL_MAJOR"};
+static const char *DIAG_NAMES[] = {"DIAG_DIRECT", "DIAG_DEFER", "DIAG_STAGE",
+                                   "DIAG_STAGE_ALL"};
+
+/**
+ * @brief Formats a strategy in the initializer syntax used by trans.c.
+ */
+static void format_params(char *buf, size_t size, const trans_params_t *p) {
+    snprintf(buf, size, "{%zu, %zu, %s, %s, %zu}", p->tile_rows,
+             p->tile_cols, ORDER_NAMES[p->order], DIAG_NAMES[p->diag],
+             p->stage_rows);
+}
+
+/** @brief The strategy of trans_small5, used as the baseline */
+static const trans_params_t SMALL5 = {8, 8, TILE_COL_MAJOR, DIAG_DEFER, 0};
+
+/**
+ * @brief Tunes one shape and prints the ranking.
+ *
+ * @return false if no candidate was correct or memory ran out
+ */
+static bool tune_shape(size_t M, size_t N, size_t top, candidate_t *best) {
+    candidate_t *cands = calloc(MAX_CANDS, sizeof(candidate_t));
+    mats_t m;
+    if (cands == NULL || !mats_alloc(&m, M, N)) {
+        free(cands);
+        return false;
+    }
+
+    size_t n = enumerate(cands, MAX_CANDS), valid = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (evaluate(&cands[i], M, N, &m)) {
+            cands[valid++] = cands[i];
+        }
+    }
+    qsort(cands, valid, sizeof(candidate_t), compare_cands);
+
+    candidate_t base = {SMALL5, 0, 0, 0, 0};
+    bool ok = valid > 0 && evaluate(&base, M, N, &m);
+    if (ok) {
+        printf("\n%zux%zu: %zu of %zu candidates correct\n", M, N, valid, n);
+        printf("  %-52s%10s%10s%12s\n", "Strategy", "Hits", "Misses",
+               "Cycles");
+        for (size_t i = 0; i < valid && i < top; i++) {
+            char buf[MAX_STR];
+            format_params(buf, sizeof(buf), &cands[i].params);
+            printf("  %-52s%10lu%10lu%12lu\n", buf, cands[i].hits,
+                   cands[i].misses, cands[i].cycles);
+        }
+        printf("  %-52s%10lu%10lu%12lu\n", "trans_small5", base.hits,
+               base.misses, base.cycles);
+        *best = cands[0];
+    }
+
+    free(cands);
+    mats_free(&m);
+    return ok;
+}
+
+/**
+ * @brief Compares transRecursive() for each leaf size against trans_small5
+ * on one shape, printing one row of misses.
+ *
+ * @return false if a kernel was incorrect or memory ran out
+ */
+static bool compare_recursive(size_t M, size_t N) {
+    mats_t m;
+    if (!mats_alloc(&m, M, N)) {
+        return false;
+    }
+
+    char buf[MAX_STR];
+    snprintf(buf, sizeof(buf), "%zux%zu", M, N);
+    printf("%-12s", buf);
+
+    candidate_t cand = {SMALL5, 0, 0, 0, 0};
+    bool ok = evaluate(&cand, M, N, &m);
+    printf("%12lu", cand.misses);
+    for (size_t i = 0; i < NEDGES && ok; i++) {
+        cand.leaf = TILE_EDGES[i];
+        ok = evaluate(&cand, M, N, &m);
+        printf("%12lu", cand.misses);
+    }
+    printf("\n");
+
+    mats_free(&m);
+    return ok;
+}
+
+/**
+ * @brief Simulates the tiled and reference kernels for one element type on
+ * one shape, printing one row of misses.
+ *
+ * @return false if the tiled kernel was incorrect or memory ran out
+ */
+static bool compare_elem(const elem_kernels_t *k, size_t M, size_t N) {
+    size_t bytes = k->size * M * N;
+    mats_t m = {aligned_malloc(bytes), aligned_malloc(bytes), malloc(bytes),
+                aligned_malloc(sizeof(double) * TMPCOUNT)};
+    if (m.A == NULL || m.B == NULL || m.Bref == NULL || m.tmp == NULL) {
+        mats_free(&m);
+        return false;
+    }
+    k->init(M, N, m.A);
+    k->correct(M, N, m.A, m.Bref);
+    sim.a = m.A;
+    sim.a_size = bytes;
+    sim.b_mat = m.B;
+    sim.b_size = bytes;
+    sim.t = (const char *)m.tmp;
+
+    char buf[MAX_STR];
+    snprintf(buf, sizeof(buf), "%zux%zu", M, N);
+    printf("%-12s", buf);
+
+    void (*kernels[])(size_t, size_t, const void *, void *) = {k->correct,
+                                                               k->trans};
+    bool ok = true;
+    for (size_t i = 0; i < 2 && ok; i++) {
+        memset(m.B, 0, bytes);
+        sim_reset();
+        kernels[i](M, N, m.A, m.B);
+        ok = !sim.bad_access && memcmp(m.B, m.Bref, bytes) == 0;
+        printf("%12lu", sim.misses);
+    }
+    printf("\n");
+
+    mats_free(&m);
+    return ok;
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-hlr] [-e <type>] [-M <cols>] [-N <rows>] [-s <s>] "
+           "[-E <E>] [-b <b>] [-k <top>]\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h        Print this help message.\n");
+    printf("  -l        Tune for the large (Haswell L1) cache\n");
+    printf("  -r        Compare trans_recursive leaf sizes to trans_small5\n");
+    printf("  -e <type> Compare the tiled and reference trans-elem.c kernels\n"
+           "            for double, float, int32, int64 or cdouble\n");
+    printf("  -M <cols> Tune only this width (with -N)\n");
+    printf("  -N <rows> Tune only this height (with -M)\n");
+    printf("  -s <s>    Number of set index bits (default %d)\n",
+           TEST_LOG_SET);
+    printf("  -E <E>    Number of lines per set (default %d)\n", TEST_ASSOC);
+    printf("  -b <b>    Number of block offset bits (default %d)\n",
+           TEST_LOG_BLOCK);
+    printf("  -k <top>  Number of strategies shown per shape (default 5)\n");
+    printf("Without -M and -N, all shapes tested by the driver are tuned,\n");
+    printf("or with -r, a range of shapes up to %d is compared.\n", MAXN);
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    size_t M = 0, N = 0, top = 5;
+    bool recursive = false;
+    const elem_kernels_t *elem = NULL;
+    int c;
+
+    sim.s = TEST_LOG_SET;
+    sim.E = TEST_ASSOC;
+    sim.b = TEST_LOG_BLOCK;
+
+    while ((c = getopt(argc, argv, "hlre:M:N:s:E:b:k:")) != -1) {
+        switch (c) {
+        case 'l':
+            sim.s = HASWELL_L1_SET;
+            sim.E = HASWELL_L1_ASSOC;
+            sim.b = HASWELL_L1_BLOCK;
+            break;
+        case 'r':
+            recursive = true;
+            break;
+        case 'e':
+            elem = findElemKernels(optarg);
+            if (elem == NULL) {
+                printf("Error: Unknown element type %s\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'M':
+            M = (size_t)atoi(optarg);
+            break;
+        case 'N':
+            N = (size_t)atoi(optarg);
+            break;
+        case 's':
+            sim.s = atoi(optarg);
+            break;
+        case 'E':
+            sim.E = atoi(optarg);
+            break;
+        case 'b':
+            sim.b = atoi(optarg);
+            break;
+        case 'k':
+            top = (size_t)atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if ((M == 0) != (N == 0) || M > MAXN || N > MAXN || sim.s < 0 ||
+        sim.s > 20 || sim.E < 1 || sim.E > 1024 || sim.b < 0 || sim.b > 20) {
+        printf("Error: Invalid shape or cache geometry\n");
+        usage(argv);
+        exit(1);
+    }
+
+    size_t lines = ((size_t)1 << sim.s) * (size_t)sim.E;
+    sim.tags = calloc(lines, sizeof(unsigned long));
+    sim.stamps = calloc(lines, sizeof(unsigned long));
+    if (sim.tags == NULL || sim.stamps == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    if (elem != NULL) {
+        bool ok = true;
+        printf("Misses for %s (%zux%zu tiles) on (s=%d, E=%d, b=%d)\n",
+               elem->name, elem->tile, elem->tile, sim.s, sim.E, sim.b);
+        printf("%-12s%12s%12s\n", "Shape", "reference", "tiled");
+        size_t nshapes = M != 0 ? 1 : NSHAPES;
+        for (size_t i = 0; i < nshapes && ok; i++) {
+            size_t m = M != 0 ? M : SHAPES[i][0];
+            size_t n = M != 0 ? N : SHAPES[i][1];
+            ok = compare_elem(elem, m, n);
+            if (!ok) {
+                fprintf(stderr, "Error: Could not compare %zux%zu\n", m, n);
+            }
+        }
+        free(sim.tags);
+        free(sim.stamps);
+        return ok ? 0 : 1;
+    }
+
+    if (recursive) {
+        bool ok = true;
+        printf("Misses on (s=%d, E=%d, b=%d)\n", sim.s, sim.E, sim.b);
+        printf("%-12s%12s", "Shape", "small5");
+        for (size_t i = 0; i < NEDGES; i++) {
+            char buf[MAX_STR];
+            snprintf(buf, sizeof(buf), "leaf=%zu", TILE_EDGES[i]);
+            printf("%12s", buf);
+        }
+        printf("\n");
+        size_t nshapes = M != 0 ? 1 : NREC_SHAPES;
+        for (size_t i = 0; i < nshapes && ok; i++) {
+            size_t m = M != 0 ? M : REC_SHAPES[i][0];
+            size_t n = M != 0 ? N : REC_SHAPES[i][1];
+            ok = compare_recursive(m, n);
+            if (!ok) {
+                fprintf(stderr, "Error: Could not compare %zux%zu\n", m, n);
+            }
+        }
+        free(sim.tags);
+        free(sim.stamps);
+        return ok ? 0 : 1;
+    }
+
+    size_t nshapes = M != 0 ? 1 : NSHAPES;
+    candidate_t best[NSHAPES];
+    bool ok = true;
+    for (size_t i = 0; i < nshapes && ok; i++) {
+        size_t m = M != 0 ? M : SHAPES[i][0];
+        size_t n = M != 0 ? N : SHAPES[i][1];
+        ok = tune_shape(m, n, top, &best[i]);
+        if (!ok) {
+            fprintf(stderr, "Error: Could not tune %zux%zu\n", m, n);
+        }
+    }
+
+    if (ok) {
+        printf("\nRows for the TUNED table in trans.c:\n");
+        for (size_t i = 0; i < nshapes; i++) {
+            size_t m = M != 0 ? M : SHAPES[i][0];
+            size_t n = M != 0 ? N : SHAPES[i][1];
+            char buf[MAX_STR];
+            format_params(buf, sizeof(buf), &best[i].params);
+            printf("    {%zu, %zu, %d, %d, %d, %s},\n", m, n, sim.s, sim.E,
+                   sim.b, buf);
+        }
+    }
+
+    free(sim.tags);
+    free(sim.stamps);
+    return ok ? 0 : 1;
+}
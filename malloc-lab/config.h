@@ -37,6 +37,7 @@
   "syn-struct-short.rep", \
   "syn-string-short.rep", \
   "syn-mix-short.rep", \
+  "realloc-extend.rep", \
   "ngram-fox1.rep", \
   "syn-mix-realloc.rep", \
   "bdd-aa4.rep", \
@@ -806,9 +806,10 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))
+    /* The payload must lie within the extent of the heap, or of a region */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_in_region(lo, hi))
     {
         malloc_error(trace, opnum, "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -1307,10 +1308,9 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   peak size of the heap in bytes while running the student's malloc
+ *   package on the trace. mem_sbrk() lets the students decrement the brk
+ *   pointer, so the final heap size can be below the peak.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1406,7 +1406,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     printf(".");
 #endif
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 /*
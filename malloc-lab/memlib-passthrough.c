@@ -5,8 +5,11 @@
  * This file allows compiling student malloc implementations so that they can
  * be used as an interpositioning library, and thereby run actual programs.
  */
+#define _GNU_SOURCE /* for mremap() */
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "config.h"
@@ -15,7 +18,7 @@
 /* private global variables */
 static bool init = false;
 static unsigned char *heap;         /* Starting address of heap */
-static unsigned char *mem_brk;      /* Current position of break */
+static _Atomic(unsigned char *) mem_brk; /* Current position of break */
 
 static void ensure_init(void) {
     if (!init) {
@@ -56,3 +59,30 @@ size_t mem_heapsize(void) {
 size_t mem_pagesize(void) {
     return (size_t)getpagesize();
 }
+
+void *mem_map(size_t size) {
+    return mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
+int mem_unmap(void *addr, size_t size) {
+    return munmap(addr, size);
+}
+
+void *mem_remap(void *addr, size_t old_size, size_t size) {
+    return mremap(addr, old_size, size, MREMAP_MAYMOVE);
+}
+
+/*
+ * Regions are not tracked here. A block of the mem_sbrk() heap lies in the
+ * heap and a mapped block in a region from mem_map(), so a range within
+ * either is in a region exactly when it lies outside the heap. Blocks of
+ * the other arenas of mm-mt.c lie outside both, and it rules them out
+ * before asking. The break is read atomically, as mm-mt.c calls this
+ * without the heap's lock.
+ */
+bool mem_in_region(const void *lo, const void *hi) {
+    ensure_init();
+    return (const unsigned char *)hi < heap ||
+           (const unsigned char *)lo >= mem_brk;
+}
@@ -31,10 +31,19 @@
  *  in non-emulation, as it was to the same page as actual heap data.  But
  *  sparse emulation has tighter checks.  Commonly, the CPU reports a
  *  BUS ERROR on these accesses, and should be debugged as segmentation faults.
+ *
+ * Besides the heap, mem_map() provides regions of memory of their own, as
+ *  mmap() does.  Dense mode maps them with mmap().  Sparse mode places them
+ *  in the upper half of the emulated address space, above any heap address,
+ *  and emulates them like the heap.  The regions are kept in a splay tree
+ *  keyed by start address, and count towards the footprint reported by
+ *  mem_peak_heapsize().
  */
+#define _GNU_SOURCE /* for mremap() */
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +62,7 @@ void markGlobalsUninit(void);
 
 #include "config.h"
 #include "memlib.h"
+#include "stree.h"
 
 /* Data structure used to implement pages in sparse memory emulation */
 typedef struct MBLK
@@ -63,11 +73,19 @@ typedef struct MBLK
     unsigned char bytes[SPARSE_PAGE_SIZE]; /* Page contents */
 } mem_block_t;
 
+/* A region created by mem_map() */
+typedef struct
+{
+    unsigned char *lo; /* Start address */
+    size_t size;       /* Size in bytes, a multiple of the page size */
+} mem_region_t;
+
 /* private global variables */
 static bool sparse = false;         /* Use sparse memory emulation */
 static unsigned char *heap;         /* Starting address of heap */
 static unsigned char *mem_brk;      /* Current position of break */
 static unsigned char *mem_max_addr; /* Maximum allowable heap address */
+static size_t peak_footprint = 0;   /* Largest heap + mapped bytes */
 static size_t mmap_length =
     MAX_DENSE_HEAP; /* Number of bytes allocated by mmap */
 static bool show_stats =
@@ -77,11 +95,19 @@ static bool stats_printed =
 
 /* Sparse memory representation */
 static mem_block_t *next_free_page = NULL; /* Next free page */
+static mem_block_t *recycled_pages = NULL; /* Pages released by mem_sbrk */
 static size_t num_pages = 0;               /* Total number of pages */
 static size_t num_free_pages = 0;          /* Number of free pages */
 static mem_block_t **page_table = NULL;    /* Hash table from page ID to page */
 static size_t num_buckets = 0;             /* Number of buckets in page table */
 
+/* Mapped regions.  The lock makes mem_map() as thread-safe as mmap() */
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static tree_t *regions = NULL;      /* Regions by start address */
+static size_t mapped_bytes = 0;     /* Total size of the regions */
+static unsigned char *map_base;     /* Start of the sparse region area */
+static unsigned char *map_brk;      /* End of the used sparse region area */
+
 #ifdef NO_CHECK_UB
 static const bool checkUB = false;
 void setUBCheck(bool val) {}
@@ -113,6 +139,12 @@ const char *__msan_default_options()
 static size_t page_id(const void *addr);
 static void *page_start(size_t id);
 static void *get_mem(const void *addr, size_t, bool);
+static void release_mem(unsigned char *lo, unsigned char *hi);
+static void release_pages(size_t first, size_t last);
+static void move_pages(size_t first, size_t last, size_t new_first);
+static bool emulated(const void *addr, size_t len);
+static void update_peak(void);
+static void unmap_all(void);
 static void print_stats();
 
 /*
@@ -164,7 +196,9 @@ void mem_init(bool do_sparse)
         /* Use initial space for page table */
         page_table = (mem_block_t **)addr;
         heap = SPARSE_HEAP_START;
-        mem_max_addr = heap + MAX_SPARSE_HEAP;
+        /* The heap gets the lower half, mapped regions the upper half */
+        mem_max_addr = heap + MAX_SPARSE_HEAP / 2;
+        map_base = mem_max_addr;
     }
     else
     {
@@ -173,6 +207,10 @@ void mem_init(bool do_sparse)
     }
     stats_printed = false;
     mem_brk = heap;
+    map_brk = map_base;
+    regions = tree_new();
+    mapped_bytes = 0;
+    peak_footprint = 0;
 }
 
 /*
@@ -181,8 +219,12 @@ void mem_init(bool do_sparse)
 void mem_deinit(void)
 {
     print_stats();
+    unmap_all();
+    tree_free(regions, NULL);
+    regions = NULL;
     munmap(heap, mmap_length);
     next_free_page = NULL;
+    recycled_pages = NULL;
     num_free_pages = 0;
     page_table = NULL;
     num_buckets = 0;
@@ -194,6 +236,7 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     print_stats();
+    unmap_all();
     if (sparse)
     {
         /* Clear page table */
@@ -201,6 +244,7 @@ void mem_reset_brk()
         memset((void *)page_table, 0, ptb);
         /* First page is just beyond page table */
         next_free_page = (mem_block_t *)((unsigned char *)page_table + ptb);
+        recycled_pages = NULL;
         num_free_pages = num_pages;
     }
     else
@@ -218,25 +262,27 @@ void mem_reset_brk()
 #endif
     }
     mem_brk = heap;
+    peak_footprint = 0;
 }
 
 /*
  * mem_sbrk - simple model of the sbrk function. Extends the heap
  *                by incr bytes and returns the start address of the new area.
- * In this model, the heap cannot be shrunk.
+ * A negative incr shrinks the heap, and gives the memory above the new
+ * break back to the system.
  */
 void *mem_sbrk(intptr_t incr)
 {
     unsigned char *old_brk = mem_brk;
 
     bool ok = true;
-    if (incr < 0)
+    if (incr < 0 && (size_t)-incr > (size_t)(mem_brk - heap))
     {
         ok = false;
         fprintf(stderr,
-                "ERROR: mem_sbrk failed.  Attempt to expand heap by negative "
-                "value %ld\n",
-                (long)incr);
+                "ERROR: mem_sbrk failed.  Attempt to shrink heap by %ld "
+                "bytes, more than its size\n",
+                -(long)incr);
     }
     else if (mem_brk + incr > mem_max_addr)
     {
@@ -247,7 +293,8 @@ void *mem_sbrk(intptr_t incr)
                 "heap size of %zd (0x%zx) bytes\n",
                 alloc, alloc);
     }
-    else if (!sparse && sbrk(incr) == (void *)-1)
+    /* The real break is only ever grown: libc may have allocated above it */
+    else if (!sparse && incr > 0 && sbrk(incr) == (void *)-1)
     {
         ok = false;
         fprintf(
@@ -255,13 +302,22 @@ void *mem_sbrk(intptr_t incr)
             "ERROR: mem_sbrk failed.  Could not allocate more heap space\n");
     }
 
-    if (ok)
+    if (ok && incr < 0)
+    {
+        mem_brk += incr;
+        release_mem(mem_brk, old_brk);
+        return (void *)old_brk;
+    }
+    else if (ok)
     {
 #ifdef USE_ASAN
         /* Mark the extended section of the heap as addressable */
         __asan_unpoison_memory_region(mem_brk, incr);
 #endif
         mem_brk += incr;
+        pthread_mutex_lock(&map_lock);
+        update_peak();
+        pthread_mutex_unlock(&map_lock);
         return (void *)old_brk;
     }
     else
@@ -295,6 +351,172 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - heap);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest number of bytes used by the
+ *    heap and the mapped regions together since the last reset
+ */
+size_t mem_peak_heapsize()
+{
+    return peak_footprint;
+}
+
+/*
+ * mem_map - model of an anonymous mmap().  Creates a region of size bytes,
+ *    rounded up to the page size, apart from the heap.  The region reads
+ *    as zero in dense mode, and as uninitialized in sparse mode.
+ */
+void *mem_map(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    void *lo = (void *)-1;
+
+    if (size == 0 || size > SIZE_MAX - pagesize)
+    {
+        errno = EINVAL;
+        return lo;
+    }
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+
+    pthread_mutex_lock(&map_lock);
+    if (!sparse)
+    {
+        lo = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    else if (size <= (size_t)(heap + MAX_SPARSE_HEAP - map_brk))
+    {
+        lo = map_brk;
+        map_brk += size;
+    }
+
+    if (lo != (void *)-1)
+    {
+        mem_region_t *r = malloc(sizeof(mem_region_t));
+        r->lo = lo;
+        r->size = size;
+        tree_insert(regions, (tkey_t)lo, r);
+        mapped_bytes += size;
+        update_peak();
+    }
+    else
+        errno = ENOMEM;
+    pthread_mutex_unlock(&map_lock);
+    return lo;
+}
+
+/*
+ * mem_unmap - model of munmap() for a whole region created by mem_map().
+ *    Returns 0 on success, and -1 if addr and size are not those of a
+ *    region.
+ */
+int mem_unmap(void *addr, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+
+    pthread_mutex_lock(&map_lock);
+    mem_region_t *r = tree_find(regions, (tkey_t)addr);
+    if (r && r->size != size)
+        r = NULL;
+    if (r)
+    {
+        tree_remove(regions, (tkey_t)addr);
+        if (sparse)
+            release_pages(page_id(r->lo), page_id(r->lo + r->size));
+        else
+            munmap(r->lo, r->size);
+        mapped_bytes -= r->size;
+        free(r);
+    }
+    pthread_mutex_unlock(&map_lock);
+
+    if (!r)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mem_remap - model of mremap() with MREMAP_MAYMOVE.  Resizes the region
+ *    at addr from old_size to size bytes, moving it if it cannot be resized in
+ *    place.  Its contents are kept without being copied: dense mode uses
+ *    mremap(), and sparse mode moves the emulated pages to the new
+ *    addresses.  Returns the new start of the region, or (void *)-1.
+ */
+void *mem_remap(void *addr, size_t old_size, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    void *lo = (void *)-1;
+
+    if (size == 0 || size > SIZE_MAX - pagesize)
+    {
+        errno = EINVAL;
+        return lo;
+    }
+    old_size = (old_size + pagesize - 1) & ~(pagesize - 1);
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+
+    pthread_mutex_lock(&map_lock);
+    mem_region_t *r = tree_find(regions, (tkey_t)addr);
+    if (r && r->size != old_size)
+        r = NULL;
+    if (!r)
+        errno = EINVAL;
+    else if (!sparse)
+        lo = mremap(r->lo, r->size, size, MREMAP_MAYMOVE);
+    else if (size <= r->size)
+    {
+        /* Shrink in place */
+        release_pages(page_id(r->lo + size), page_id(r->lo + r->size));
+        if (r->lo + r->size == map_brk)
+            map_brk = r->lo + size;
+        lo = r->lo;
+    }
+    else if (r->lo + r->size == map_brk &&
+             size - r->size <= (size_t)(heap + MAX_SPARSE_HEAP - map_brk))
+    {
+        /* The last region grows in place */
+        map_brk = r->lo + size;
+        lo = r->lo;
+    }
+    else if (size <= (size_t)(heap + MAX_SPARSE_HEAP - map_brk))
+    {
+        /* Move the pages of the region to a new one */
+        lo = map_brk;
+        map_brk += size;
+        move_pages(page_id(r->lo), page_id(r->lo + r->size), page_id(lo));
+    }
+
+    if (lo != (void *)-1)
+    {
+        tree_remove(regions, (tkey_t)r->lo);
+        mapped_bytes = mapped_bytes - r->size + size;
+        r->lo = lo;
+        r->size = size;
+        tree_insert(regions, (tkey_t)lo, r);
+        update_peak();
+    }
+    else if (r)
+        errno = ENOMEM;
+    pthread_mutex_unlock(&map_lock);
+    return lo;
+}
+
+/*
+ * mem_in_region - returns true if the bytes from lo to hi all lie within
+ *    one region created by mem_map()
+ */
+bool mem_in_region(const void *lo, const void *hi)
+{
+    pthread_mutex_lock(&map_lock);
+    mem_region_t *r = tree_find_nearest(regions, (tkey_t)lo);
+    bool in = r && (const unsigned char *)hi < r->lo + r->size;
+    pthread_mutex_unlock(&map_lock);
+    return in;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -323,8 +545,7 @@ void mem_write128(void *addr, __int128 val)
 uint64_t mem_read(const void *addr, size_t len)
 {
     uint64_t rdata;
-    if (sparse && (unsigned char *)addr >= heap &&
-        (unsigned char *)addr + len <= mem_brk)
+    if (sparse && emulated(addr, len))
     {
         /* Heap read.  Check if it crosses page boundary */
         size_t id = page_id(addr);
@@ -367,8 +588,7 @@ uint64_t mem_read(const void *addr, size_t len)
 /* Write lower order len bytes of val to address */
 void mem_write(void *addr, uint64_t val, size_t len)
 {
-    if (sparse && (unsigned char *)addr >= heap &&
-        (unsigned char *)addr + len <= mem_brk)
+    if (sparse && emulated(addr, len))
     {
         /* Heap write.  Check to see if it crosses page boundary */
         size_t id = page_id(addr);
@@ -547,7 +767,13 @@ static void *get_mem(const void *addr, size_t size, bool isWrite)
             fprintf(stderr, "FAILURE.  Ran out of memory for emulation\n");
             exit(1);
         }
-        block = next_free_page++;
+        if (recycled_pages)
+        {
+            block = recycled_pages;
+            recycled_pages = block->next;
+        }
+        else
+            block = next_free_page++;
         num_free_pages--;
         block->id = id;
         block->next = page_table[b];
@@ -599,3 +825,141 @@ static void *get_mem(const void *addr, size_t size, bool isWrite)
 
     return (void *)&block->bytes[offset];
 }
+
+/*
+ * Give the memory between lo and hi, just released by mem_sbrk, back to
+ *  the system.  Dense mode drops the whole pages in the range, so that they
+ *  no longer count towards the resident set and read as zero when the heap
+ *  grows again.  Sparse mode unlinks the emulated pages that lie wholly in
+ *  the range and recycles them.
+ */
+static void release_mem(unsigned char *lo, unsigned char *hi)
+{
+#ifdef USE_ASAN
+    /* Mark the released section of the heap as unaddressable */
+    __asan_poison_memory_region(lo, hi - lo);
+#endif
+    if (sparse)
+        release_pages(page_id(lo + SPARSE_PAGE_SIZE - 1), page_id(hi - 1) + 1);
+    else
+    {
+        size_t pagesize = mem_pagesize();
+        uintptr_t start = ((uintptr_t)lo + pagesize - 1) & ~(pagesize - 1);
+        if (start < (uintptr_t)hi)
+            madvise((void *)start, (uintptr_t)hi - start, MADV_DONTNEED);
+    }
+}
+
+/*
+ * Unlink the emulated pages with IDs from first to last - 1, and recycle
+ *  them.  Large ranges, as when a giant block or region is released, are
+ *  handled by looking at each page in the page table rather than at each
+ *  ID in the range.
+ */
+static void release_pages(size_t first, size_t last)
+{
+    size_t id, b;
+    if (first >= last)
+        return;
+    if (last - first <= num_buckets)
+    {
+        for (id = first; id < last; id++)
+        {
+            mem_block_t **link = &page_table[id % num_buckets];
+            while (*link && (*link)->id != id)
+                link = &(*link)->next;
+            if (*link)
+            {
+                mem_block_t *block = *link;
+                *link = block->next;
+                block->next = recycled_pages;
+                recycled_pages = block;
+                num_free_pages++;
+            }
+        }
+        return;
+    }
+    for (b = 0; b < num_buckets; b++)
+    {
+        mem_block_t **link = &page_table[b];
+        while (*link)
+        {
+            mem_block_t *block = *link;
+            if (block->id >= first && block->id < last)
+            {
+                *link = block->next;
+                block->next = recycled_pages;
+                recycled_pages = block;
+                num_free_pages++;
+            }
+            else
+                link = &block->next;
+        }
+    }
+}
+
+/*
+ * Give the emulated pages with IDs from first to last - 1 the IDs from
+ *  new_first on, which moves their contents to the new addresses.
+ */
+static void move_pages(size_t first, size_t last, size_t new_first)
+{
+    mem_block_t *moved = NULL;
+    size_t b;
+    for (b = 0; b < num_buckets; b++)
+    {
+        mem_block_t **link = &page_table[b];
+        while (*link)
+        {
+            mem_block_t *block = *link;
+            if (block->id >= first && block->id < last)
+            {
+                *link = block->next;
+                block->next = moved;
+                moved = block;
+            }
+            else
+                link = &block->next;
+        }
+    }
+    while (moved)
+    {
+        mem_block_t *block = moved;
+        moved = block->next;
+        block->id = block->id - first + new_first;
+        block->next = page_table[block->id % num_buckets];
+        page_table[block->id % num_buckets] = block;
+    }
+}
+
+/* Is the access of len bytes at addr to the emulated heap or regions? */
+static bool emulated(const void *addr, size_t len)
+{
+    const unsigned char *a = addr;
+    return (a >= heap && a + len <= mem_brk) ||
+           (a >= map_base && a + len <= map_brk);
+}
+
+/* Record the current footprint if it is the largest.  Needs map_lock */
+static void update_peak(void)
+{
+    size_t footprint = (size_t)(mem_brk - heap) + mapped_bytes;
+    if (footprint > peak_footprint)
+        peak_footprint = footprint;
+}
+
+/* Unmap all regions, as when the heap is reset */
+static void unmap_all(void)
+{
+    pthread_mutex_lock(&map_lock);
+    while (regions && regions->root)
+    {
+        mem_region_t *r = tree_remove(regions, regions->root->key);
+        if (!sparse)
+            munmap(r->lo, r->size);
+        free(r);
+    }
+    mapped_bytes = 0;
+    map_brk = map_base;
+    pthread_mutex_unlock(&map_lock);
+}
@@ -24,13 +24,14 @@ void mem_deinit(void);
 /**
  * @brief Extends the heap by incr bytes.
  *
- * This function is a simple model of the sbrk() function, except for that
- * with this implementation, the heap cannot be shrunk.
+ * This function is a simple model of the sbrk() function. A negative incr
+ * shrinks the heap by -incr bytes, and the memory above the new break is
+ * given back to the system.
  *
  * @param[in] incr The amount of bytes by which to extend the heap
  * @return The start address of the new heap area (i.e. the previous
  *         breakpoint)
- * @pre `incr > 0`
+ * @pre `-incr <= mem_heapsize()`
  */
 void *mem_sbrk(intptr_t incr);
 
@@ -61,6 +62,53 @@ void *mem_heap_hi(void);
  */
 size_t mem_heapsize(void);
 
+/**
+ * @brief Returns the largest number of bytes used by the heap and the mapped
+ *        regions together since the heap was reset.
+ * @return The peak footprint, in bytes
+ */
+size_t mem_peak_heapsize(void);
+
+/**
+ * @brief Creates a region of memory apart from the heap.
+ *
+ * This function is a simple model of an anonymous mmap(). Regions are
+ * unmapped when the heap is reset.
+ *
+ * @param[in] size The size of the region, rounded up to the page size
+ * @return The page-aligned start of the region, or (void *)-1 on failure
+ */
+void *mem_map(size_t size);
+
+/**
+ * @brief Unmaps a region created by mem_map().
+ * @param[in] addr The start of the region
+ * @param[in] size The size the region was created or last resized with
+ * @return 0 on success, -1 if there is no such region
+ */
+int mem_unmap(void *addr, size_t size);
+
+/**
+ * @brief Resizes a region created by mem_map(), moving it if needed.
+ *
+ * This function is a simple model of mremap() with MREMAP_MAYMOVE: the
+ * contents of the region are kept without being copied.
+ *
+ * @param[in] addr The start of the region
+ * @param[in] old_size The current size of the region
+ * @param[in] size The new size of the region, rounded up to the page size
+ * @return The new start of the region, or (void *)-1 on failure
+ */
+void *mem_remap(void *addr, size_t old_size, size_t size);
+
+/**
+ * @brief Checks whether a range of bytes lies within one mapped region.
+ * @param[in] lo The first byte of the range
+ * @param[in] hi The last byte of the range
+ * @return True if the range lies within a region created by mem_map()
+ */
+bool mem_in_region(const void *lo, const void *hi);
+
 /**
  * @brief Returns the system page size.
  * @return The page size of the system, in bytes
@@ -0,0 +1,420 @@
+/**
+ * @file mm-mt.c
+ * @brief A thread-safe front end for the allocator in mm.c
+ *
+ * Linked with mm.c compiled with MM_THREADS, this file provides malloc,
+ * free, realloc and calloc (mm_malloc etc. with DRIVER) for multi-threaded
+ * programs. mm.c then manages one heap per arena, and this file decides
+ * which arena serves which call:
+ *
+ * - Arenas. Arena 0 is the mem_sbrk() heap. Each further arena manages a
+ *   heap inside a region of MT_ARENA_BYTES reserved with mmap(). There is
+ *   one arena per CPU, at most MT_MAX_ARENAS (or MM_ARENAS from the
+ *   environment), and each has its own lock. Threads are assigned to
+ *   arenas round-robin when they first allocate, so threads on different
+ *   arenas do not contend.
+ *
+ * - Thread caches. Each thread keeps up to MT_CACHE_COUNT free blocks of
+ *   its arena for each of MT_CACHE_CLASSES small sizes, in LIFO lists
+ *   linked through the payloads. The blocks stay allocated as far as mm.c
+ *   is concerned, so most small mallocs and frees take no lock at all.
+ *
+ * - Remote frees. A block is always freed into the arena it came from,
+ *   which is found from its address. A thread freeing blocks of another
+ *   arena queues them, and returns each queue to its arena under a single
+ *   lock acquisition once MT_REMOTE_BATCH blocks have gathered.
+ *
+ * - Mapped blocks. Large blocks that mm.c gives a region of their own
+ *   belong to no arena, so any thread frees or resizes them directly,
+ *   through its own arena.
+ *
+ * Caches and queues are flushed when their thread exits, and the cache of
+ * the caller by mm_trim().
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+/** @brief Maximum number of arenas */
+#define MT_MAX_ARENAS 16
+
+/** @brief Size of the region reserved for each arena but the first */
+#define MT_ARENA_BYTES ((size_t)1 << 30)
+
+/**
+ * @brief Number of size classes in a thread cache
+ *
+ * Class k holds blocks of 16k to 16k + 15 usable bytes, which all fit any
+ * request of up to 16k bytes, so the cache covers requests of up to
+ * 16 * (MT_CACHE_CLASSES - 1) bytes.
+ */
+#define MT_CACHE_CLASSES 16
+
+/** @brief Maximum number of blocks in each list of a thread cache */
+#define MT_CACHE_COUNT 32
+
+/** @brief Number of queued remote frees returned to an arena at once */
+#define MT_REMOTE_BATCH 32
+
+/**
+ * @brief Struct representing one arena and its lock
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    arena_t *arena;
+    char *base; /* start of the region, or NULL for the mem_sbrk() heap */
+} mt_arena_t;
+
+/**
+ * @brief Struct representing the per-thread state
+ */
+typedef struct {
+    int home;                            /* arena of the thread, or -1 */
+    void *bins[MT_CACHE_CLASSES];        /* cached free blocks of home */
+    unsigned counts[MT_CACHE_CLASSES];   /* length of each list in bins */
+    void *remote[MT_MAX_ARENAS];         /* queued frees for each arena */
+    unsigned nremote[MT_MAX_ARENAS];     /* length of each queue */
+} mt_cache_t;
+
+static mt_arena_t arenas[MT_MAX_ARENAS];
+static int narenas = 0;
+
+/** @brief Arena the next new thread is assigned to, modulo narenas */
+static atomic_uint next_home = 0;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/** @brief Key whose destructor flushes the cache of an exiting thread */
+static pthread_key_t cache_key;
+
+static _Thread_local mt_cache_t cache = {.home = -1};
+
+/**
+ * @brief Returns the number of arenas to create.
+ */
+static int arena_count(void) {
+    const char *env = getenv("MM_ARENAS");
+    long count = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count < 1) {
+        count = 1;
+    }
+    return count < MT_MAX_ARENAS ? (int)count : MT_MAX_ARENAS;
+}
+
+/**
+ * @brief Returns the arena that allocated the payload bp, or -1 if bp is the
+ * payload of a mapped block.
+ *
+ * The regions of the arenas are checked first: mm_is_mapped() may take any
+ * payload outside the mem_sbrk() heap for a mapped block, which those of
+ * the other arenas are not.
+ */
+static int owner_of(void *bp) {
+    for (int i = 1; i < narenas; i++) {
+        if ((char *)bp >= arenas[i].base &&
+            (char *)bp < arenas[i].base + MT_ARENA_BYTES) {
+            return i;
+        }
+    }
+    return mm_is_mapped(bp) ? -1 : 0;
+}
+
+/**
+ * @brief Locks arena i, and makes the calling thread work on it.
+ */
+static void lock_arena(int i) {
+    pthread_mutex_lock(&arenas[i].lock);
+    mm_arena_select(arenas[i].arena);
+}
+
+static void unlock_arena(int i) {
+    pthread_mutex_unlock(&arenas[i].lock);
+}
+
+/**
+ * @brief Frees the queued remote frees for arena i.
+ */
+static void flush_remote(mt_cache_t *c, int i) {
+    void *bp = c->remote[i];
+
+    lock_arena(i);
+    while (bp != NULL) {
+        void *next = *(void **)bp;
+        mm_arena_free(bp);
+        bp = next;
+    }
+    unlock_arena(i);
+
+    c->remote[i] = NULL;
+    c->nremote[i] = 0;
+}
+
+/**
+ * @brief Frees the blocks in the thread cache.
+ */
+static void flush_bins(mt_cache_t *c) {
+    lock_arena(c->home);
+    for (int k = 0; k < MT_CACHE_CLASSES; k++) {
+        void *bp = c->bins[k];
+        while (bp != NULL) {
+            void *next = *(void **)bp;
+            mm_arena_free(bp);
+            bp = next;
+        }
+        c->bins[k] = NULL;
+        c->counts[k] = 0;
+    }
+    unlock_arena(c->home);
+}
+
+/**
+ * @brief Returns everything a thread holds to the arenas.
+ *
+ * Runs as the destructor of cache_key when the thread exits.
+ */
+static void flush_cache(void *arg) {
+    mt_cache_t *c = arg;
+
+    if (c->home < 0) {
+        return;
+    }
+
+    flush_bins(c);
+    for (int i = 0; i < narenas; i++) {
+        if (c->remote[i] != NULL) {
+            flush_remote(c, i);
+        }
+    }
+    c->home = -1;
+}
+
+/**
+ * @brief Creates the arenas, and initializes their heaps.
+ *
+ * Arenas whose region cannot be reserved are left out.
+ */
+static void mt_init(void) {
+    int count = arena_count();
+
+    pthread_key_create(&cache_key, flush_cache);
+
+    pthread_mutex_init(&arenas[0].lock, NULL);
+    arenas[0].arena = mm_arena_main();
+    arenas[0].base = NULL;
+    narenas = 1;
+
+    while (narenas < count) {
+        void *region = mmap(NULL, MT_ARENA_BYTES, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                            0);
+        if (region == MAP_FAILED) {
+            break;
+        }
+
+        mt_arena_t *a = &arenas[narenas];
+        pthread_mutex_init(&a->lock, NULL);
+        a->arena = mm_arena_create(region, MT_ARENA_BYTES);
+        a->base = region;
+        narenas++;
+    }
+
+    for (int i = 0; i < narenas; i++) {
+        mm_arena_select(arenas[i].arena);
+        mm_init();
+    }
+}
+
+/**
+ * @brief Returns the state of the calling thread, assigning it an arena
+ * on its first call.
+ */
+static mt_cache_t *get_cache(void) {
+    if (cache.home >= 0) {
+        return &cache;
+    }
+
+    pthread_once(&init_once, mt_init);
+    cache.home = (int)(atomic_fetch_add(&next_home, 1) % (unsigned)narenas);
+    pthread_setspecific(cache_key, &cache);
+    return &cache;
+}
+
+/**
+ * @brief Returns the cache class of a block with usable size bytes.
+ */
+static size_t block_class(size_t usable) {
+    return usable / 16;
+}
+
+/**
+ * @brief Returns the cache class whose blocks fit a request of size bytes.
+ */
+static size_t request_class(size_t size) {
+    return (size + 15) / 16;
+}
+
+/**
+ * @brief Allocates a block of at least size bytes.
+ *
+ * Takes a block from the thread cache if it has one of the right class,
+ * and otherwise allocates from the thread's arena.
+ */
+void *malloc(size_t size) {
+    mt_cache_t *c = get_cache();
+    size_t k = request_class(size);
+    void *bp;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (k < MT_CACHE_CLASSES && c->bins[k] != NULL) {
+        bp = c->bins[k];
+        c->bins[k] = *(void **)bp;
+        c->counts[k]--;
+        return bp;
+    }
+
+    lock_arena(c->home);
+    bp = mm_arena_malloc(size);
+    unlock_arena(c->home);
+    return bp;
+}
+
+/**
+ * @brief Frees a block.
+ *
+ * Small blocks of the thread's own arena go to the thread cache while it
+ * has room. Blocks of other arenas are queued for their arena, and mapped
+ * blocks are unmapped right away.
+ */
+void free(void *bp) {
+    if (bp == NULL) {
+        return;
+    }
+
+    mt_cache_t *c = get_cache();
+    int owner = owner_of(bp);
+
+    if (owner < 0) {
+        lock_arena(c->home);
+        mm_arena_free(bp);
+        unlock_arena(c->home);
+        return;
+    }
+
+    if (owner != c->home) {
+        *(void **)bp = c->remote[owner];
+        c->remote[owner] = bp;
+        if (++c->nremote[owner] == MT_REMOTE_BATCH) {
+            flush_remote(c, owner);
+        }
+        return;
+    }
+
+    size_t k = block_class(mm_usable_size(arenas[owner].arena, bp));
+    if (k < MT_CACHE_CLASSES && c->counts[k] < MT_CACHE_COUNT) {
+        *(void **)bp = c->bins[k];
+        c->bins[k] = bp;
+        c->counts[k]++;
+        return;
+    }
+
+    lock_arena(owner);
+    mm_arena_free(bp);
+    unlock_arena(owner);
+}
+
+/**
+ * @brief Changes the size of a block.
+ *
+ * A block of the thread's own arena, or a mapped block, is resized by mm.c.
+ * A block of another arena is moved into the thread's arena instead, so
+ * that the other arena is only touched by the batched remote free.
+ */
+void *realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    mt_cache_t *c = get_cache();
+    int owner = owner_of(ptr);
+    void *bp;
+
+    if (owner < 0 || owner == c->home) {
+        lock_arena(c->home);
+        bp = mm_arena_realloc(ptr, size);
+        unlock_arena(c->home);
+        return bp;
+    }
+
+    bp = malloc(size);
+    if (bp == NULL) {
+        return NULL;
+    }
+    size_t old_size = mm_usable_size(arenas[owner].arena, ptr);
+    memcpy(bp, ptr, old_size < size ? old_size : size);
+    free(ptr);
+    return bp;
+}
+
+/**
+ * @brief Allocates a zeroed array of elements blocks of size bytes.
+ */
+void *calloc(size_t elements, size_t size) {
+    size_t asize = elements * size;
+
+    if (elements == 0) {
+        return NULL;
+    }
+    if (asize / elements != size) {
+        // Multiplication overflowed
+        return NULL;
+    }
+
+    void *bp = malloc(asize);
+    if (bp != NULL) {
+        memset(bp, 0, asize);
+    }
+    return bp;
+}
+
+/**
+ * @brief Gives the free memory at the end of each arena back to the system.
+ *
+ * The blocks in the calling thread's cache are freed first. Those in the
+ * caches of other threads stay allocated.
+ */
+bool mm_trim(void) {
+    mt_cache_t *c = get_cache();
+    bool trimmed = false;
+
+    flush_bins(c);
+    for (int i = 0; i < narenas; i++) {
+        lock_arena(i);
+        trimmed |= mm_arena_trim();
+        unlock_arena(i);
+    }
+    return trimmed;
+}
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "memlib.h"
@@ -47,6 +48,19 @@
 
 /* You can change anything from here onward */
 
+#ifdef MM_THREADS
+/* mm-mt.c provides the public functions, and calls these with a lock held */
+#undef malloc
+#undef free
+#undef realloc
+#undef calloc
+#define malloc mm_arena_malloc
+#define free mm_arena_free
+#define realloc mm_arena_realloc
+#define calloc mm_arena_calloc
+#define mm_trim mm_arena_trim
+#endif /* def MM_THREADS */
+
 /*
  *****************************************************************************
  * If DEBUG is defined (such as when running mdriver-dbg), these macros      *
@@ -117,6 +131,57 @@ static const word_t size_mask = ~(word_t)0xF;
  */
 static const word_t next_mask = ~(word_t)0x7;
 
+/**
+ * @brief Initial size above which a free block at the end of the heap is
+ * trimmed
+ */
+static const size_t trim_threshold_min = (1 << 17);
+
+/** @brief Largest size the trim threshold is raised to */
+static const size_t trim_threshold_max = (1 << 26);
+
+/** @brief Free bytes left at the end of the heap when it is trimmed */
+static const size_t trim_keep = (1 << 15);
+
+/** @brief Smallest request served from a mapped region of its own */
+static const size_t map_threshold = (1 << 18);
+
+/** @brief Size of a slab block, to whose size its payload is aligned */
+static const size_t slab_bytes = (1 << 12);
+
+/** @brief log2 of slab_bytes */
+static const size_t slab_shift = 12;
+
+/** @brief Largest request served from a slab */
+static const size_t slab_max = 128;
+
+/** @brief Number of slab size classes, one per dsize up to slab_max */
+#define SLAB_CLASSES 8
+
+/** @brief Number of words in the free bitmap of a slab */
+#define SLAB_BITMAP_WORDS 4
+
+/** @brief Number of words in each leaf of the page map of the slabs */
+#define SLAB_LEAF_WORDS 16
+
+/** @brief Number of leaves of the page map, which covers 16 GB of heap */
+#define SLAB_LEAVES 4096
+
+/** @brief Number of heap pages covered by one leaf of the page map */
+static const size_t slab_leaf_pages = 64 * SLAB_LEAF_WORDS;
+
+/** @brief Largest block size kept in a quick list */
+static const size_t quick_max = 256;
+
+/** @brief Number of quick lists, one per dsize up to quick_max */
+#define QUICK_LISTS 16
+
+/** @brief Number of blocks a quick list holds before it is coalesced */
+static const size_t quick_count_max = 32;
+
+/** @brief Bytes the quick lists hold before they are all coalesced */
+static const size_t quick_bytes_max = (1 << 14);
+
 /** @brief Represents the header and payload of one block in the heap */
 typedef struct block {
     /** @brief Header contains size + allocation flag */
@@ -147,22 +212,114 @@ typedef struct block {
             /** @brief pointer to previous free block*/
             struct block *prev;
         };
+        struct {
+            /** @brief Left child in the tree of large free blocks */
+            struct block *left;
+            /** @brief Right child in the tree of large free blocks */
+            struct block *right;
+            /** @brief Parent in the tree, or NULL for the root */
+            struct block *parent;
+            /** @brief True if the node is red */
+            word_t red;
+        };
         /** @brief payload of allocated block*/
         char payload[0];
     };
 
 } block_t;
 
+/**
+ * @brief Header of a slab, at the start of its payload
+ *
+ * A slab is an allocated block of slab_bytes, whose payload starts on a
+ * multiple of slab_bytes and holds this header followed by objects of one
+ * size class. The objects have no header of their own: free() finds the
+ * slab of a pointer by rounding it down, once the page map of the arena
+ * says that the page is a slab.
+ */
+typedef struct slab {
+    /** @brief Next slab with a free object in the list of the class */
+    struct slab *next;
+    /** @brief Previous slab with a free object in the list of the class */
+    struct slab *prev;
+    /** @brief Size of each object */
+    word_t size;
+    /** @brief Number of free objects */
+    word_t nfree;
+    /** @brief Bit i is set if and only if object i is free */
+    word_t free_map[SLAB_BITMAP_WORDS];
+} slab_t;
+
 /* Global variables */
 
-/** @brief Pointer to first block in the heap */
-static block_t *heap_start = NULL;
+/** @brief Number of buckets in seglist */
+#define BUCKET_NUM 7
 
-/** @brief Global variable that stores the number of buckets in seglist */
-const size_t BUCKET_NUM = 15;
+/**
+ * @brief Size above which free blocks are kept in a tree instead of the
+ * seglist, which is where the last bucket ends
+ */
+static const size_t tree_min = (1 << 10);
 
-/** @brief Pointer to the head of the explicit list */
-block_t *seglist[BUCKET_NUM];
+/**
+ * @brief State of one heap and its segregated free lists
+ *
+ * The allocator works on the arena pointed to by `arena`, which is always
+ * main_arena, grown with mem_sbrk(), unless mm.c is built with MM_THREADS.
+ * mm-mt.c then also creates arenas in regions of their own (region_end is
+ * set), and each thread selects the arena it works on.
+ */
+struct arena {
+    /** @brief Pointer to first block in the heap */
+    block_t *heap_start;
+    /** @brief Pointer to the head of each explicit list */
+    block_t *seglist[BUCKET_NUM];
+    /** @brief Bit i is set if and only if seglist[i] is not empty */
+    word_t bucket_map;
+    /** @brief Root of the red-black tree of free blocks above tree_min */
+    block_t *tree;
+    /** @brief Freed blocks not yet coalesced, one list per block size */
+    block_t *quick[QUICK_LISTS];
+    /** @brief Number of blocks in each quick list */
+    size_t quick_count[QUICK_LISTS];
+    /** @brief Total size of the blocks in the quick lists */
+    size_t quick_bytes;
+    /** @brief Slabs with a free object, for each size class */
+    slab_t *slabs[SLAB_CLASSES];
+    /** @brief Requests of each size class, counted until the class is hot */
+    size_t slab_requests[SLAB_CLASSES];
+    /**
+     * @brief Page map of the slabs: bit i of leaf j is set if and only if
+     * heap page j * slab_leaf_pages + i is a slab, and a leaf is NULL until
+     * a slab is made in its pages
+     */
+    word_t *slab_map[SLAB_LEAVES];
+    /** @brief Number of leading leaves of slab_map that may be set */
+    size_t slab_leaves;
+    /** @brief First leaf of slab_map, which most heaps never go beyond */
+    word_t slab_leaf[SLAB_LEAF_WORDS];
+    /** @brief Current break of an arena in a region */
+    char *brk;
+    /** @brief End of the region, or NULL for the mem_sbrk() heap */
+    char *region_end;
+    /** @brief Size above which the free block at the end is trimmed */
+    size_t trim_threshold;
+    /** @brief Largest size the heap has reached */
+    size_t heap_peak;
+    /** @brief True if the heap was trimmed since it was last extended */
+    bool trimmed;
+};
+
+/** @brief The arena whose heap is grown with mem_sbrk() */
+static arena_t main_arena;
+
+#ifdef MM_THREADS
+/** @brief Arena of the calling thread, see mm_arena_select() */
+static _Thread_local arena_t *arena = &main_arena;
+#else
+/** @brief Arena being worked on */
+static arena_t *const arena = &main_arena;
+#endif
 
 /*
  *****************************************************************************
@@ -194,6 +351,16 @@ static size_t max(size_t x, size_t y) {
     return (x > y) ? x : y;
 }
 
+/**
+ * @brief Returns the minimum of two integers.
+ * @param[in] x
+ * @param[in] y
+ * @return `x` if `x < y`, and `y` otherwise.
+ */
+static size_t min(size_t x, size_t y) {
+    return (x < y) ? x : y;
+}
+
 /**
  * @brief Rounds `size` up to next multiple of n
  * @param[in] size
@@ -443,6 +610,71 @@ static word_t mini_get_next(block_t *block) {
     return extract_header((word_t)(block->next));
 }
 
+/**
+ * @brief Extends the heap of the current arena by size bytes.
+ *
+ * The main arena grows with mem_sbrk(), other arenas within their region.
+ *
+ * @param[in] size
+ * @return The start of the new area, or (void *)-1 if out of memory
+ */
+static void *arena_sbrk(size_t size) {
+    if (arena->region_end == NULL) {
+        return mem_sbrk((intptr_t)size);
+    }
+    if (size > (size_t)(arena->region_end - arena->brk)) {
+        return (void *)-1;
+    }
+    char *old_brk = arena->brk;
+    arena->brk += size;
+    return old_brk;
+}
+
+/**
+ * @brief Shrinks the heap of the current arena by size bytes.
+ *
+ * The memory above the new end of the heap is given back to the system.
+ *
+ * @param[in] size
+ * @return True on success, false otherwise
+ */
+static bool arena_shrink(size_t size) {
+    if (arena->region_end == NULL) {
+        return mem_sbrk(-(intptr_t)size) != (void *)-1;
+    }
+
+    arena->brk -= size;
+
+    // Drop the whole pages between the new and the old end of the heap
+    uintptr_t pagesize = mem_pagesize();
+    uintptr_t start = ((uintptr_t)arena->brk + pagesize - 1) & ~(pagesize - 1);
+    uintptr_t end = (uintptr_t)arena->brk + size;
+    if (start < end) {
+        madvise((void *)start, end - start, MADV_DONTNEED);
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the address of the first heap byte of the current arena.
+ */
+static void *arena_heap_lo(void) {
+    if (arena->region_end == NULL) {
+        return mem_heap_lo();
+    }
+    return (char *)arena + round_up(sizeof(arena_t), dsize);
+}
+
+/**
+ * @brief Returns the address of the last heap byte of the current arena.
+ */
+static void *arena_heap_hi(void) {
+    if (arena->region_end == NULL) {
+        return mem_heap_hi();
+    }
+    return arena->brk - 1;
+}
+
 /**
  * @brief Writes an epilogue header at the given address.
  *
@@ -452,7 +684,7 @@ static word_t mini_get_next(block_t *block) {
  */
 static void write_epilogue(block_t *block) {
     dbg_requires(block != NULL);
-    dbg_requires((char *)block == mem_heap_hi() - 7);
+    dbg_requires((char *)block == arena_heap_hi() - 7);
     block->header = pack(0, true, false);
 }
 
@@ -476,6 +708,32 @@ static block_t *find_next(block_t *block) {
     return (block_t *)((char *)block + get_size(block));
 }
 
+/**
+ * @brief Reads a word that mm-mt.c may read without the arena's lock.
+ *
+ * With MM_THREADS, such words are read and written atomically. This costs
+ * nothing on x86-64, where the accesses are plain moves either way, but
+ * makes the lock-free reads well defined.
+ */
+static word_t load_word(const word_t *p) {
+#ifdef MM_THREADS
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#else
+    return *p;
+#endif
+}
+
+/**
+ * @brief Writes a word that mm-mt.c may read without the arena's lock.
+ */
+static void store_word(word_t *p, word_t word) {
+#ifdef MM_THREADS
+    __atomic_store_n(p, word, __ATOMIC_RELAXED);
+#else
+    *p = word;
+#endif
+}
+
 /**
  * @brief Writes a block requested from memory to be stored in heap.
  *
@@ -505,7 +763,9 @@ static void extend_write(block_t *block, size_t size, bool alloc,
  * This function writes both a header and footer (if the block is not
  * allocated), where the location of the
  * footer is computed in relation to the header.
- * It also updates the prev_alloc bit of the next block in heap.
+ * It also updates the prev_alloc bit of the next block in heap, whose
+ * header is written with store_word() as the block may be allocated (see
+ * mm_usable_size()).
  *
  * @pre The block must not be NULL
  * @pre The size must be greater than 0
@@ -533,16 +793,17 @@ static void write_block(block_t *block, size_t size, bool alloc,
         bool next_alloc = get_alloc(next);
         bool next_mini = get_mini(next);
         if (!next_mini) {
-            next->header = pack(next_size, next_alloc, alloc);
+            store_word(&next->header, pack(next_size, next_alloc, alloc));
             if (!next_alloc) {
-                word_t *footerp = header_to_footer(block);
+                word_t *footerp = header_to_footer(next);
                 *footerp = pack(next_size, next_alloc, alloc);
             }
         }
         // Next block in heap is mini block
         else {
             size_t next_header = mini_get_header(next);
-            next->header = mini_pack((word_t)next_header, next_alloc, alloc);
+            store_word(&next->header,
+                       mini_pack((word_t)next_header, next_alloc, alloc));
             // When next block is not allocated, modify next (payload)
             if (!next_alloc) {
                 block_t *next_next = (block_t *)mini_get_next(next);
@@ -566,16 +827,17 @@ static void write_block(block_t *block, size_t size, bool alloc,
         size_t next_size;
         if (!next_mini) {
             next_size = get_size(next);
-            next->header = pack(next_size, next_alloc, alloc);
+            store_word(&next->header, pack(next_size, next_alloc, alloc));
             if (!next_alloc) {
-                word_t *footerp = header_to_footer(block);
+                word_t *footerp = header_to_footer(next);
                 *footerp = pack(next_size, next_alloc, alloc);
             }
         }
         // Next block in heap is mini block
         else {
             size_t next_header = mini_get_header(next);
-            next->header = mini_pack((word_t)next_header, next_alloc, alloc);
+            store_word(&next->header,
+                       mini_pack((word_t)next_header, next_alloc, alloc));
             if (!next_alloc) {
                 block_t *next_next = (block_t *)mini_get_next(next);
                 next->next =
@@ -637,49 +899,348 @@ static block_t *find_prev(block_t *block) {
 
 /**
  * @brief Finds the bucket index based on the block size
- * @param[in] size
+ *
+ * Bucket 0 holds the mini blocks of 16 bytes, and bucket i > 0 holds sizes
+ * in (2^(i+3), 2^(i+4)], up to the last bucket, which ends at tree_min.
+ * The index is ceil(log2(size)) - 4, computed by counting the leading
+ * zeros of size - 1.
+ *
+ * @param[in] size At most tree_min
  * @return The bucket index in seglist of given size
  */
 static size_t find_bucket(size_t size) {
     dbg_requires(size > 0);
-    if (size <= 16) {
+    dbg_requires(size <= tree_min);
+    if (size <= min_block_size) {
         return 0;
-    } else if (size > 16 && size <= 32) {
-        return 1;
-    } else if (size > 32 && size <= 64) {
-        return 2;
-    } else if (size > 64 && size <= 128) {
-        return 3;
-    } else if (size > 128 && size <= 256) {
-        return 4;
-    } else if (size > 256 && size <= 512) {
-        return 5;
-    } else if (size > 512 && size <= 1024) {
-        return 6;
-    } else if (size > 1024 && size <= 2048) {
-        return 7;
-    } else if (size > 2048 && size <= 4096) {
-        return 8;
-    } else if (size > 4096 && size <= 8192) {
-        return 9;
-    } else if (size > 8192 && size <= 16384) {
-        return 10;
-    } else if (size > 16384 && size <= 32768) {
-        return 11;
-    } else if (size > 32768 && size <= 65536) {
-        return 12;
-    } else if (size > 65536 && size <= 131072) {
-        return 13;
+    }
+    return (size_t)(64 - __builtin_clzl(size - 1)) - 4;
+}
+
+/**
+ * @brief Marks a bucket of the seglist as empty or not in bucket_map
+ * @param[in] bucket
+ * @param[in] nonempty True if the bucket has at least one block
+ */
+static void mark_bucket(size_t bucket, bool nonempty) {
+    if (nonempty) {
+        arena->bucket_map |= (word_t)1 << bucket;
+    } else {
+        arena->bucket_map &= ~((word_t)1 << bucket);
+    }
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        TREE OF LARGE FREE BLOCKS
+ *
+ * Free blocks larger than tree_min are kept in a red-black tree ordered by
+ * size, and by address between blocks of the same size, whose nodes are
+ * the payloads of the blocks. Missing children are NULL, and count as
+ * black. find_fit() then gets the smallest block that fits, and the one
+ * with the lowest address among those, in O(log n).
+ * ---------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Returns true if block a sorts before block b in the tree.
+ */
+static bool tree_less(block_t *a, block_t *b) {
+    size_t a_size = get_size(a);
+    size_t b_size = get_size(b);
+    return a_size < b_size || (a_size == b_size && a < b);
+}
+
+/**
+ * @brief Returns true if node is a red node, false if it is black or NULL.
+ */
+static bool is_red(block_t *node) {
+    return node != NULL && node->red;
+}
+
+/**
+ * @brief Puts node in the place of old in the tree, as the child of the
+ * parent of old.
+ *
+ * @param[in] old A node in the tree
+ * @param[in] node The replacement, or NULL
+ */
+static void tree_replace(block_t *old, block_t *node) {
+    block_t *parent = old->parent;
+
+    if (parent == NULL) {
+        arena->tree = node;
+    } else if (parent->left == old) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+    if (node != NULL) {
+        node->parent = parent;
+    }
+}
+
+/**
+ * @brief Rotates the tree left around node, whose right child takes its
+ * place.
+ */
+static void rotate_left(block_t *node) {
+    block_t *child = node->right;
+
+    node->right = child->left;
+    if (child->left != NULL) {
+        child->left->parent = node;
+    }
+    tree_replace(node, child);
+    child->left = node;
+    node->parent = child;
+}
+
+/**
+ * @brief Rotates the tree right around node, whose left child takes its
+ * place.
+ */
+static void rotate_right(block_t *node) {
+    block_t *child = node->left;
+
+    node->left = child->right;
+    if (child->right != NULL) {
+        child->right->parent = node;
+    }
+    tree_replace(node, child);
+    child->right = node;
+    node->parent = child;
+}
+
+/**
+ * @brief Inserts a free block into the tree, and rebalances it.
+ * @param[in] block A free block larger than tree_min
+ */
+static void tree_insert(block_t *block) {
+    block_t **link = &arena->tree;
+    block_t *parent = NULL;
+
+    while (*link != NULL) {
+        parent = *link;
+        link = tree_less(block, parent) ? &parent->left : &parent->right;
+    }
+    block->left = NULL;
+    block->right = NULL;
+    block->parent = parent;
+    block->red = true;
+    *link = block;
+
+    // Only a red node with a red parent breaks the tree
+    while ((parent = block->parent) != NULL && parent->red) {
+        block_t *grandparent = parent->parent;
+
+        if (parent == grandparent->left) {
+            block_t *uncle = grandparent->right;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                block = grandparent;
+                continue;
+            }
+            if (block == parent->right) {
+                rotate_left(parent);
+                block = parent;
+                parent = block->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_right(grandparent);
+        } else {
+            block_t *uncle = grandparent->left;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                block = grandparent;
+                continue;
+            }
+            if (block == parent->left) {
+                rotate_right(parent);
+                block = parent;
+                parent = block->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_left(grandparent);
+        }
+    }
+    arena->tree->red = false;
+}
+
+/**
+ * @brief Restores the tree after a black node was removed from the
+ * subtree of parent whose root is now node.
+ *
+ * @param[in] node The root of the subtree short of a black node, or NULL
+ * @param[in] parent The parent of node
+ */
+static void tree_delete_fixup(block_t *node, block_t *parent) {
+    while (node != arena->tree && !is_red(node)) {
+        if (node == parent->left) {
+            block_t *sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_left(parent);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rotate_right(sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rotate_left(parent);
+        } else {
+            block_t *sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_right(parent);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rotate_left(sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rotate_right(parent);
+        }
+        node = arena->tree;
+    }
+    if (node != NULL) {
+        node->red = false;
+    }
+}
+
+/**
+ * @brief Removes a block from the tree, and rebalances it.
+ *
+ * A block with two children is replaced by its successor, the leftmost
+ * node of its right subtree, which has no left child.
+ *
+ * @param[in] block A block in the tree
+ */
+static void tree_delete(block_t *block) {
+    block_t *child;
+    block_t *parent;
+    bool removed_red;
+
+    if (block->left == NULL || block->right == NULL) {
+        child = block->left != NULL ? block->left : block->right;
+        parent = block->parent;
+        removed_red = block->red;
+        tree_replace(block, child);
     } else {
-        return 14;
+        block_t *successor = block->right;
+        while (successor->left != NULL) {
+            successor = successor->left;
+        }
+        child = successor->right;
+        removed_red = successor->red;
+        if (successor->parent == block) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            tree_replace(successor, child);
+            successor->right = block->right;
+            successor->right->parent = successor;
+        }
+        tree_replace(block, successor);
+        successor->left = block->left;
+        successor->left->parent = successor;
+        successor->red = block->red;
+    }
+
+    if (!removed_red) {
+        tree_delete_fixup(child, parent);
+    }
+}
+
+/**
+ * @brief Finds the smallest block of the tree with at least asize bytes,
+ * the one with the lowest address if there are several.
+ *
+ * @param[in] asize
+ * @return The block, or NULL if no block in the tree is large enough
+ */
+static block_t *tree_fit(size_t asize) {
+    block_t *best = NULL;
+    block_t *node = arena->tree;
+
+    while (node != NULL) {
+        if (get_size(node) >= asize) {
+            best = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Checks the subtree of the tree rooted at node.
+ *
+ * @param[in] node The root of the subtree, or NULL
+ * @param[in] parent The parent node should have
+ * @param[in] lo A node that every node of the subtree sorts after, or NULL
+ * @param[in] hi A node that every node of the subtree sorts before, or NULL
+ * @param[out] count Incremented by the number of nodes in the subtree
+ * @return The number of black nodes on each path down from node, or -1 if
+ * the subtree is broken
+ */
+static int check_tree(block_t *node, block_t *parent, block_t *lo,
+                      block_t *hi, size_t *count) {
+    if (node == NULL) {
+        return 0;
+    }
+    if (get_alloc(node) || get_size(node) <= tree_min ||
+        node->parent != parent || (lo != NULL && !tree_less(lo, node)) ||
+        (hi != NULL && !tree_less(node, hi)) ||
+        (node->red && (is_red(node->left) || is_red(node->right)))) {
+        return -1;
     }
+    (*count)++;
+
+    int left = check_tree(node->left, node, lo, node, count);
+    int right = check_tree(node->right, node, node, hi, count);
+    if (left < 0 || left != right) {
+        return -1;
+    }
+    return left + (node->red ? 0 : 1);
 }
 
 /**
  * @brief Prints all the blocks and their informations on heap
  */
 static void print_heap() {
-    block_t *tmp = heap_start;
+    block_t *tmp = arena->heap_start;
     while (get_size(tmp) != 0) {
         block_t *prev;
         if (!get_prev_alloc(tmp)) {
@@ -698,7 +1259,8 @@ static void print_heap() {
 }
 
 /**
- * @brief Insert a given block into the segregated lists
+ * @brief Insert a given block into the segregated lists, or into the tree
+ * if it is larger than tree_min
  * @param[in] block
  */
 static void insert(block_t *block) {
@@ -707,55 +1269,66 @@ static void insert(block_t *block) {
         return;
     }
     if (!get_mini(block)) {
+        if (get_size(block) > tree_min) {
+            tree_insert(block);
+            return;
+        }
         size_t bucket = find_bucket(get_size(block));
         // the bucket doesn't have any block
-        if (seglist[bucket] == NULL) {
-            seglist[bucket] = block;
+        if (arena->seglist[bucket] == NULL) {
+            arena->seglist[bucket] = block;
             block->prev = NULL;
             block->next = NULL;
         } else {
-            seglist[bucket]->prev = block;
-            block->next = seglist[bucket];
+            arena->seglist[bucket]->prev = block;
+            block->next = arena->seglist[bucket];
             block->prev = NULL;
-            seglist[bucket] = block;
+            arena->seglist[bucket] = block;
         }
+        mark_bucket(bucket, true);
     }
     // The inserted block is mini block
     else {
         bool prev_alloc = get_prev_alloc(block);
         bool alloc = get_alloc(block);
         // The bucket is empty
-        if (seglist[0] == NULL) {
-            seglist[0] = block;
+        if (arena->seglist[0] == NULL) {
+            arena->seglist[0] = block;
             block->header = mini_pack((word_t)0, alloc, prev_alloc);
             block->next = (block_t *)mini_pack((word_t)0, alloc, prev_alloc);
         } else {
-            block_t *head = seglist[0];
+            block_t *head = arena->seglist[0];
             bool head_alloc = get_alloc(head);
             bool head_prev_alloc = get_prev_alloc(head);
             head->next = (block_t *)mini_pack((word_t)block, head_alloc,
                                               head_prev_alloc);
             block->header = mini_pack((word_t)head, alloc, prev_alloc);
             block->next = (block_t *)mini_pack((word_t)0, alloc, prev_alloc);
-            seglist[0] = block;
+            arena->seglist[0] = block;
         }
+        mark_bucket(0, true);
     }
 }
 
 /**
- * @brief Deletes a block from the segregated list
+ * @brief Deletes a block from the segregated list, or from the tree
  * @param[in] block
  */
 static void delete (block_t *block) {
     if (!get_mini(block)) {
+        if (get_size(block) > tree_min) {
+            tree_delete(block);
+            return;
+        }
         size_t bucket = find_bucket(get_size(block));
         // block is the first element in the bucket
-        if (block == seglist[bucket]) {
+        if (block == arena->seglist[bucket]) {
             // Only block in this bucket
             if (block->next == NULL) {
-                seglist[bucket] = NULL;
+                arena->seglist[bucket] = NULL;
+                mark_bucket(bucket, false);
             } else {
-                seglist[bucket] = block->next;
+                arena->seglist[bucket] = block->next;
                 block->next->prev = NULL;
             }
             // block is not the first element in the bucket
@@ -772,14 +1345,15 @@ static void delete (block_t *block) {
     // The block is mini block
     else {
         // First block in the bucket
-        if (block == seglist[0]) {
+        if (block == arena->seglist[0]) {
             // Only block in this bucket
             if (mini_get_header(block) == 0) {
-                seglist[0] = NULL;
+                arena->seglist[0] = NULL;
+                mark_bucket(0, false);
             } else {
-                seglist[0] = (block_t *)mini_get_header(block);
-                bool prev_alloc = get_prev_alloc(seglist[0]);
-                seglist[0]->next =
+                arena->seglist[0] = (block_t *)mini_get_header(block);
+                bool prev_alloc = get_prev_alloc(arena->seglist[0]);
+                arena->seglist[0]->next =
                     (block_t *)mini_pack((word_t)0, false, prev_alloc);
             }
         }
@@ -928,10 +1502,20 @@ static block_t *extend_heap(size_t size) {
 
     // Allocate an even number of words to maintain alignment
     size = round_up(size, dsize);
-    if ((bp = mem_sbrk(size)) == (void *)-1) {
+    if ((bp = arena_sbrk(size)) == (void *)-1) {
         return NULL;
     }
 
+    // Growing again after a trim: only trim once past the peak from now on
+    if (arena->trimmed) {
+        arena->trimmed = false;
+        arena->trim_threshold = max(arena->trim_threshold,
+                                    min(arena->heap_peak, trim_threshold_max));
+    }
+    arena->heap_peak =
+        max(arena->heap_peak, (size_t)((char *)arena_heap_hi() -
+                                       (char *)arena_heap_lo() + 1));
+
     // Initialize free block header/footer
     block_t *block = payload_to_header(bp);
     bool prev_alloc = get_prev_alloc(block);
@@ -950,6 +1534,61 @@ static block_t *extend_heap(size_t size) {
     return block;
 }
 
+/**
+ * @brief Shrinks the heap so that the free block at its end keeps only
+ * keep bytes, or disappears if keep is 0.
+ *
+ * @param[in] block The free block followed by the epilogue
+ * @param[in] keep Size to leave the block with, a multiple of dsize
+ * @return True if the heap was shrunk, false otherwise
+ */
+static bool trim_heap(block_t *block, size_t keep) {
+    size_t size = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+
+    dbg_requires(!get_alloc(block));
+    dbg_requires(get_size(find_next(block)) == 0);
+    dbg_requires(keep == 0 || keep > min_block_size);
+
+    if (size <= keep || !arena_shrink(size - keep)) {
+        return false;
+    }
+
+    arena->trimmed = true;
+    delete (block);
+    if (keep == 0) {
+        // The block becomes the epilogue
+        dbg_assert((char *)block == arena_heap_hi() - 7);
+        block->header = pack(0, true, prev_alloc);
+    } else {
+        extend_write(block, keep, false, prev_alloc, false);
+        write_epilogue(find_next(block));
+        insert(block);
+    }
+    return true;
+}
+
+/**
+ * @brief Trims the heap if block is a free block at its end that is larger
+ * than the trim threshold of the arena.
+ *
+ * The heap is trimmed down to trim_keep free bytes, so a heap that shrinks
+ * and grows again by a little does not give back and request the same
+ * memory each time. A heap that has to grow again after being trimmed
+ * raises the threshold to the largest size it has reached, up to
+ * trim_threshold_max, so that it is only trimmed again once it outgrows
+ * that peak, and a program that keeps swinging between the same sizes
+ * stops paying for a trim and a regrow each time.
+ *
+ * @param[in] block A free block
+ */
+static void trim_if_large(block_t *block) {
+    if (get_size(block) > arena->trim_threshold &&
+        get_size(find_next(block)) == 0) {
+        trim_heap(block, trim_keep);
+    }
+}
+
 /**
  * @brief Splits a block to two smaller blocks that both have
  * a size larger than minimum block size.
@@ -971,10 +1610,13 @@ static block_t *split_block(block_t *block, size_t asize) {
 
     if ((block_size - asize) >= min_block_size) {
         bool prev_alloc = get_prev_alloc(block);
-        block_t *block_next;
+        block_t *block_next = (block_t *)((char *)block + asize);
+
+        // The remainder holds stale data: give it a header before
+        // write_block() reads it as the next block
+        block_next->header = pack(block_size - asize, true, true);
         write_block(block, asize, true, prev_alloc, asize == min_block_size);
 
-        block_next = find_next(block);
         write_block(block_next, block_size - asize, false, true,
                     (block_size - asize) == min_block_size);
         return block_next;
@@ -988,6 +1630,12 @@ static block_t *split_block(block_t *block, size_t asize) {
 /**
  * @brief Find a block of the requested size and return it to caller.
  *
+ * Only the non-empty buckets at or above the bucket of asize are visited,
+ * in increasing order, by taking the lowest set bit of bucket_map each
+ * time. Every block in a bucket above that of asize fits, so at most one
+ * bucket is searched without success. Sizes above tree_min, and those no
+ * bucket has a block for, take the best fit in the tree.
+ *
  * If no satisfactory block can be found, return NULL.
  *
  * @param[in] asize
@@ -999,18 +1647,27 @@ static block_t *find_fit(size_t asize) {
 
     // Search for a mini block
     if (asize == min_block_size) {
-        if (seglist[0] != NULL) {
-            return seglist[0];
+        if (arena->seglist[0] != NULL) {
+            return arena->seglist[0];
         }
     }
 
+    if (asize > tree_min) {
+        return tree_fit(asize);
+    }
+
     size_t bucket = find_bucket(asize);
+    word_t candidates = arena->bucket_map & ~(((word_t)1 << bucket) - 1);
+
+    while (candidates != 0) {
+        bucket = (size_t)__builtin_ctzl(candidates);
+        candidates &= candidates - 1;
 
-    while (bucket < BUCKET_NUM) {
         // Search for the smallest block in the first 5 satisfying blocks
         block_t *best = NULL;
         size_t level = 5;
-        for (block = seglist[bucket]; block != NULL; block = block->next) {
+        for (block = arena->seglist[bucket]; block != NULL;
+             block = block->next) {
             if (asize <= get_size(block)) {
                 dbg_assert(!get_alloc(block));
                 if (best == NULL || get_size(best) > get_size(block)) {
@@ -1022,54 +1679,761 @@ static block_t *find_fit(size_t asize) {
                 break;
             }
         }
-        if (best == NULL) {
-            bucket++;
-        } else {
+        if (best != NULL) {
             return best;
         }
     }
 
-    return NULL; // no fit found
+    // Every block in the tree fits
+    return tree_fit(asize);
 }
 
 /**
- * @brief Checks everything about the heap, the seglist, and blocks
- *
- * As described in the writeup.
- * If and only if there is an error, prints information about the error
- * and return false.
- *
- * @param[in] line
- * @return True if the heap passes the checks, false otherwise.
+ * @brief Frees an allocated block, and coalesces it with its neighbors.
+ * @param[in] block
  */
-bool mm_checkheap(int line) {
-
-    block_t *prologue = (block_t *)((word_t *)heap_start - 1);
-    block_t *epilogue = (block_t *)((char *)mem_heap_hi() - 7);
+static void release_block(block_t *block) {
+    size_t size = get_size(block);
 
-    // Checks prologue for size and alloc bit
-    if ((size_t)prologue < (size_t)mem_heap_lo() ||
-        get_alloc(prologue) == false || get_size(prologue) != 0) {
-        dbg_printf("prologue error line %d\n", line);
-        return false;
-    }
+    // The block should be marked as allocated
+    dbg_assert(get_alloc(block));
 
-    // Checks epilogue for size and alloc bit
-    if (get_alloc(epilogue) == false || get_size(epilogue) != 0) {
-        dbg_printf("epilogue error line %d\n", line);
-        return false;
-    }
-    if (get_mini(epilogue)) {
-        dbg_printf("epilogue is mini line %d\n", line);
-    }
+    // Mark the block as free
+    bool prev_alloc = get_prev_alloc(block);
+    write_block(block, size, false, prev_alloc, get_mini(block));
 
-    block_t *block = heap_start;
-    block_t *next_in_heap;
-    size_t free_count_heap = 0;
-    size_t free_count_list = 0;
-    bool curr_alloc;
+    // Try to coalesce the block with its neighbors
+    block = coalesce_block(block);
+    insert(block);
+    trim_if_large(block);
+}
 
-    while (block != epilogue) {
+/*
+ * ---------------------------------------------------------------------------
+ *                                QUICK LISTS
+ *
+ * Freed blocks of up to quick_max bytes are not coalesced right away, but
+ * kept in a LIFO list for their exact size, from which a request of that
+ * size is served first. They stay marked as allocated meanwhile, so that
+ * no neighbor coalesces with them, and are linked through their payloads.
+ * A list is coalesced as a whole when it grows past quick_count_max
+ * blocks, and all of them when together they grow past quick_bytes_max
+ * bytes, or when no free block fits a request.
+ * ---------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Returns the quick list of blocks of the given size.
+ * @param[in] size A block size of up to quick_max
+ */
+static size_t quick_index(size_t size) {
+    dbg_requires(size >= min_block_size && size <= quick_max);
+    return size / dsize - 1;
+}
+
+/**
+ * @brief Frees the blocks of one quick list, and coalesces them.
+ * @param[in] index
+ */
+static void quick_flush_list(size_t index) {
+    block_t *block = arena->quick[index];
+
+    while (block != NULL) {
+        block_t *next = block->next;
+        arena->quick_bytes -= get_size(block);
+        release_block(block);
+        block = next;
+    }
+    arena->quick[index] = NULL;
+    arena->quick_count[index] = 0;
+}
+
+/**
+ * @brief Frees the blocks of all the quick lists, and coalesces them.
+ * @return True if any block was freed
+ */
+static bool quick_flush(void) {
+    if (arena->quick_bytes == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < QUICK_LISTS; i++) {
+        quick_flush_list(i);
+    }
+    return true;
+}
+
+/**
+ * @brief Frees an allocated block, putting it in its quick list if it has
+ * one instead of coalescing it.
+ * @param[in] block
+ */
+static void quick_free(block_t *block) {
+    size_t size = get_size(block);
+
+    dbg_requires(get_alloc(block));
+
+    if (size > quick_max) {
+        release_block(block);
+        return;
+    }
+
+    size_t index = quick_index(size);
+    block->next = arena->quick[index];
+    arena->quick[index] = block;
+    arena->quick_bytes += size;
+
+    if (++arena->quick_count[index] > quick_count_max) {
+        quick_flush_list(index);
+    } else if (arena->quick_bytes > quick_bytes_max) {
+        quick_flush();
+    }
+}
+
+/**
+ * @brief Takes a block of exactly asize bytes from its quick list.
+ * @param[in] asize Adjusted block size
+ * @return The block, still allocated, or NULL if the list is empty
+ */
+static block_t *quick_alloc(size_t asize) {
+    if (asize > quick_max) {
+        return NULL;
+    }
+
+    size_t index = quick_index(asize);
+    block_t *block = arena->quick[index];
+    if (block != NULL) {
+        arena->quick[index] = block->next;
+        arena->quick_count[index]--;
+        arena->quick_bytes -= asize;
+    }
+    return block;
+}
+
+/* Defined with the slabs, which allocate regular blocks themselves */
+static bool slab_flush(void);
+
+/**
+ * @brief Allocates a block of asize bytes from the segregated lists.
+ *
+ * A block of the same size from the quick lists is taken first. If there
+ * is no satisfactory block in the lists, even once the quick lists are
+ * coalesced, requests more space from memory. Writes the block as
+ * allocated, and splits block if it is large.
+ *
+ * @param[in] asize Adjusted block size
+ * @return The allocated block, or NULL if out of memory
+ */
+static block_t *alloc_block(size_t asize) {
+    block_t *block = quick_alloc(asize);
+    if (block != NULL) {
+        return block;
+    }
+
+    // Search the free list for a fit
+    block = find_fit(asize);
+    if (block == NULL && quick_flush()) {
+        block = find_fit(asize);
+    }
+    if (block == NULL && slab_flush()) {
+        block = find_fit(asize);
+    }
+
+    // If no fit is found, request more memory, and then and place the block
+    if (block == NULL) {
+        // Always request at least chunksize
+        block = extend_heap(max(asize, chunksize));
+        // extend_heap returns an error
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    // The block should be marked as free
+    dbg_assert(!get_alloc(block));
+
+    // Mark block as allocated
+    size_t block_size = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+    write_block(block, block_size, true, prev_alloc, get_mini(block));
+
+    delete (block);
+
+    // Try to split the block if too large
+    if (block_size > min_block_size) {
+        block_t *rest = split_block(block, asize);
+
+        if (rest != NULL) {
+            insert(rest);
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief Resizes an allocated block to asize bytes without moving it.
+ *
+ * A block shrinks by splitting off its tail. It grows by absorbing the free
+ * block that follows it and, when that brings it to the end of the heap
+ * but is still too small, by extending the heap. What is left over is split
+ * off and freed.
+ *
+ * @param[in] block An allocated block
+ * @param[in] asize Adjusted block size
+ * @return True if the block now has size asize, false if it must be moved
+ */
+static bool resize_block(block_t *block, size_t asize) {
+    size_t block_size = get_size(block);
+    block_t *rest;
+
+    dbg_requires(get_alloc(block));
+    dbg_requires(asize > min_block_size);
+
+    if (asize > block_size) {
+        block_t *next = find_next(block);
+        block_t *end = next;
+        size_t avail = block_size;
+
+        if (!get_alloc(next)) {
+            avail += get_size(next);
+            end = find_next(next);
+        }
+
+        if (avail < asize) {
+            // Only the last block of the heap can grow into new memory. The
+            // new free block must not be a mini block, which extend_heap()
+            // cannot write; split_block() frees what is left over.
+            if (get_size(end) != 0 ||
+                extend_heap(max(asize - avail, 2 * dsize)) == NULL) {
+                return false;
+            }
+            next = find_next(block);
+        }
+
+        // Absorb the free block that follows
+        bool prev_alloc = get_prev_alloc(block);
+        block_size += get_size(next);
+        delete (next);
+        write_block(block, block_size, true, prev_alloc, false);
+    }
+
+    rest = split_block(block, asize);
+    if (rest != NULL) {
+        rest = coalesce_block(rest);
+        insert(rest);
+        trim_if_large(rest);
+    }
+    return true;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                                  SLABS
+ *
+ * Requests of up to slab_max bytes are served from slabs, one size class
+ * per dsize, when that saves space (see use_slab()). Each class keeps a
+ * list of its slabs that have a free object, sorted by address, and a slab
+ * is given back to the segregated lists once all its objects are free,
+ * unless it is the last slab of the list. The slab pages of the heap are
+ * recorded in a page map of fixed-size bitmaps. The first is part of the
+ * arena, and each further one is kept in a regular block made when the
+ * first slab lands in its part of the heap. The bitmaps never move, so
+ * that mm-mt.c can look a page up without the arena's lock.
+ * ---------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Returns the number of objects of the given size in one slab.
+ */
+static size_t slab_count(size_t size) {
+    return (slab_bytes - wsize - sizeof(slab_t)) / size;
+}
+
+/**
+ * @brief Returns the address of the first object of a slab.
+ */
+static char *slab_objects(slab_t *slab) {
+    return (char *)slab + sizeof(slab_t);
+}
+
+/**
+ * @brief Returns the index of the heap page of an arena holding the given
+ * address.
+ */
+static size_t slab_page(const arena_t *owner, const void *p) {
+    return ((uintptr_t)p >> slab_shift) -
+           ((uintptr_t)owner->heap_start >> slab_shift);
+}
+
+/**
+ * @brief Returns the leaf of the page map of an arena covering a page, or
+ * NULL if no slab was ever made in its pages.
+ *
+ * A leaf is published with release order once it is zeroed, so a thread
+ * without the arena's lock sees it whole.
+ */
+static word_t *slab_leaf(const arena_t *owner, size_t page) {
+    if (page / slab_leaf_pages >= SLAB_LEAVES) {
+        return NULL;
+    }
+    word_t *const *leaf = &owner->slab_map[page / slab_leaf_pages];
+#ifdef MM_THREADS
+    return __atomic_load_n(leaf, __ATOMIC_ACQUIRE);
+#else
+    return *leaf;
+#endif
+}
+
+/**
+ * @brief Returns the slab holding the payload bp, or NULL if bp is the
+ * payload of a regular block.
+ *
+ * The payload of a regular block is never in the page of a slab, as the
+ * block after a slab starts with the last word of that page. The bit of
+ * the page of a live object or block does not change, so this needs no
+ * lock when bp is live.
+ *
+ * @param[in] owner The arena that allocated bp
+ * @param[in] bp
+ */
+static slab_t *find_slab(const arena_t *owner, void *bp) {
+    size_t page = slab_page(owner, bp);
+    word_t *leaf = slab_leaf(owner, page);
+    size_t bit = page % slab_leaf_pages;
+
+    if (leaf == NULL || !((load_word(&leaf[bit / 64]) >> (bit % 64)) & 1)) {
+        return NULL;
+    }
+    return (slab_t *)((uintptr_t)bp & ~(uintptr_t)(slab_bytes - 1));
+}
+
+/**
+ * @brief Makes the leaf of the page map with the given index, which must
+ * have none yet.
+ *
+ * @return The zeroed leaf, or NULL if out of memory
+ */
+static word_t *make_slab_leaf(size_t index) {
+    block_t *block =
+        alloc_block(round_up(SLAB_LEAF_WORDS * wsize + wsize, dsize));
+    if (block == NULL) {
+        return NULL;
+    }
+
+    word_t *leaf = (word_t *)header_to_payload(block);
+    for (size_t i = 0; i < SLAB_LEAF_WORDS; i++) {
+        leaf[i] = 0;
+    }
+#ifdef MM_THREADS
+    __atomic_store_n(&arena->slab_map[index], leaf, __ATOMIC_RELEASE);
+#else
+    arena->slab_map[index] = leaf;
+#endif
+    arena->slab_leaves = max(arena->slab_leaves, index + 1);
+    return leaf;
+}
+
+/**
+ * @brief Records in the page map whether the page of a slab is in use.
+ *
+ * Makes the leaf of the page map covering the slab first if there is none.
+ *
+ * @return False if the page map does not reach the slab, or its leaf could
+ * not be made
+ */
+static bool mark_slab_page(slab_t *slab, bool in_use) {
+    size_t page = slab_page(arena, slab);
+    size_t index = page / slab_leaf_pages;
+    size_t bit = page % slab_leaf_pages;
+
+    if (index >= SLAB_LEAVES) {
+        return false;
+    }
+
+    word_t *leaf = arena->slab_map[index];
+    if (leaf == NULL && (leaf = make_slab_leaf(index)) == NULL) {
+        return false;
+    }
+
+    word_t mask = (word_t)1 << (bit % 64);
+    word_t word = leaf[bit / 64];
+    store_word(&leaf[bit / 64], in_use ? word | mask : word & ~mask);
+    return true;
+}
+
+/**
+ * @brief Finds or makes a free block that holds a slab block.
+ *
+ * The payload of a slab must start on a multiple of slab_bytes, which
+ * every free block of at least 2 * slab_bytes - dsize bytes allows. If
+ * there is none, the heap is extended by just enough for the free block
+ * at its end to allow it.
+ *
+ * @return A free block in the segregated lists, or NULL if out of memory
+ */
+static block_t *find_slab_fit(void) {
+    block_t *block = find_fit(2 * slab_bytes - dsize);
+    if (block == NULL && quick_flush()) {
+        block = find_fit(2 * slab_bytes - dsize);
+    }
+    if (block != NULL) {
+        return block;
+    }
+
+    // The last block, if free, and the new space are merged into one
+    block_t *epilogue = (block_t *)((char *)arena_heap_hi() - 7);
+    block_t *last = get_prev_alloc(epilogue) ? epilogue : find_prev(epilogue);
+    uintptr_t slab = round_up((uintptr_t)last + wsize, slab_bytes);
+    size_t end = (size_t)(slab + slab_bytes - wsize);
+
+    if (end <= (size_t)epilogue) {
+        return last;
+    }
+    return extend_heap(end - (size_t)epilogue);
+}
+
+/**
+ * @brief Creates an empty slab for objects of the given size.
+ * @return The new slab, or NULL if out of memory
+ */
+static slab_t *new_slab(size_t size) {
+    block_t *block = find_slab_fit();
+    if (block == NULL) {
+        return NULL;
+    }
+
+    // Split off the space before and after the aligned slab block
+    char *payload = header_to_payload(block);
+    slab_t *slab = (slab_t *)round_up((uintptr_t)payload, slab_bytes);
+    block_t *slab_block = payload_to_header(slab);
+    size_t pad = (size_t)((char *)slab_block - (char *)block);
+    size_t block_size = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+
+    delete (block);
+    write_block(slab_block, block_size - pad, true, pad == 0 && prev_alloc,
+                false);
+    if (pad > 0) {
+        write_block(block, pad, false, prev_alloc, pad == min_block_size);
+        insert(block);
+    }
+    block_t *rest = split_block(slab_block, slab_bytes);
+    if (rest != NULL) {
+        insert(rest);
+    }
+
+    if (!mark_slab_page(slab, true)) {
+        release_block(slab_block);
+        return NULL;
+    }
+
+    size_t count = slab_count(size);
+    slab->size = size;
+    slab->nfree = count;
+    for (size_t i = 0; i < SLAB_BITMAP_WORDS; i++) {
+        if (count >= 64 * (i + 1)) {
+            slab->free_map[i] = ~(word_t)0;
+        } else if (count > 64 * i) {
+            slab->free_map[i] = ((word_t)1 << (count - 64 * i)) - 1;
+        } else {
+            slab->free_map[i] = 0;
+        }
+    }
+    return slab;
+}
+
+/**
+ * @brief Adds a slab to the list of its class, in address order.
+ *
+ * Objects are allocated from the first slab of the list, so keeping the
+ * lists sorted packs objects into the lowest slabs, and lets the others
+ * drain and be released. Without this, slabs with a few live objects pin
+ * pages all over the heap, and utilization drops on the ngram traces.
+ */
+static void slab_insert(slab_t *slab) {
+    slab_t *prev = NULL;
+    slab_t *next = arena->slabs[slab->size / dsize - 1];
+
+    while (next != NULL && next < slab) {
+        prev = next;
+        next = next->next;
+    }
+
+    slab->prev = prev;
+    slab->next = next;
+    if (prev != NULL) {
+        prev->next = slab;
+    } else {
+        arena->slabs[slab->size / dsize - 1] = slab;
+    }
+    if (next != NULL) {
+        next->prev = slab;
+    }
+}
+
+/**
+ * @brief Removes a slab from the list of its class.
+ */
+static void slab_unlink(slab_t *slab) {
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        arena->slabs[slab->size / dsize - 1] = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/**
+ * @brief Returns true if a request of up to slab_max bytes is better
+ * served from a slab than as a regular block.
+ *
+ * A slab only saves space on requests whose regular block would be larger
+ * than their object, which is not the case for those of up to wsize more
+ * bytes than a multiple of dsize. It also pins a whole page for its class,
+ * which costs more than it saves when the class only ever has a few
+ * objects, as in the short traces or the rare classes of the bdd ones. A
+ * class is only served from slabs once it is hot, after a slab's worth of
+ * requests, which are counted until then.
+ */
+static bool use_slab(size_t size) {
+    size_t size_class = (size - 1) / dsize;
+
+    if (size % dsize != 0 && size % dsize <= wsize) {
+        return false;
+    }
+    if (arena->slab_requests[size_class] >=
+        slab_count((size_class + 1) * dsize)) {
+        return true;
+    }
+    arena->slab_requests[size_class]++;
+    return false;
+}
+
+/**
+ * @brief Allocates an object of at least size bytes from a slab.
+ *
+ * Takes the first free object of the first slab of the class, found from
+ * the free bitmap, and makes a new slab if the class has none.
+ *
+ * @param[in] size
+ * @return The object, or NULL if out of memory
+ */
+static void *slab_malloc(size_t size) {
+    size_t size_class = (size - 1) / dsize;
+    slab_t *slab = arena->slabs[size_class];
+
+    if (slab == NULL) {
+        slab = new_slab((size_class + 1) * dsize);
+        if (slab == NULL) {
+            return NULL;
+        }
+        slab_insert(slab);
+    }
+
+    size_t word = 0;
+    while (slab->free_map[word] == 0) {
+        word++;
+    }
+    size_t index = 64 * word + (size_t)__builtin_ctzl(slab->free_map[word]);
+    slab->free_map[word] &= slab->free_map[word] - 1;
+
+    if (--slab->nfree == 0) {
+        slab_unlink(slab);
+    }
+    return slab_objects(slab) + index * slab->size;
+}
+
+/**
+ * @brief Frees an object of a slab.
+ *
+ * A slab that was full goes back to the list of its class, and a slab that
+ * becomes empty is released, unless it is the last one of the list, which
+ * is kept until slab_flush().
+ */
+static void slab_free(slab_t *slab, void *bp) {
+    size_t index = (size_t)((char *)bp - slab_objects(slab)) / slab->size;
+
+    dbg_assert(!((slab->free_map[index / 64] >> (index % 64)) & 1));
+    slab->free_map[index / 64] |= (word_t)1 << (index % 64);
+
+    if (++slab->nfree == 1) {
+        slab_insert(slab);
+    } else if (slab->nfree == slab_count(slab->size) &&
+               (slab->prev != NULL || slab->next != NULL)) {
+        slab_unlink(slab);
+        mark_slab_page(slab, false);
+        release_block(payload_to_header(slab));
+    }
+}
+
+/**
+ * @brief Releases the empty slabs kept as the last of their list.
+ *
+ * Called before the heap is extended for a regular block, as such a slab
+ * may split the free space it needs, as at the end of the ngram traces.
+ *
+ * @return True if any slab was released
+ */
+static bool slab_flush(void) {
+    bool flushed = false;
+
+    for (size_t i = 0; i < SLAB_CLASSES; i++) {
+        slab_t *slab = arena->slabs[i];
+        while (slab != NULL) {
+            slab_t *next = slab->next;
+            if (slab->nfree == slab_count(slab->size)) {
+                slab_unlink(slab);
+                mark_slab_page(slab, false);
+                release_block(payload_to_header(slab));
+                flushed = true;
+            }
+            slab = next;
+        }
+    }
+    return flushed;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                              MAPPED BLOCKS
+ *
+ * Requests of at least map_threshold bytes get a region of their own from
+ * mem_map(), which is unmapped when they are freed, so they neither
+ * fragment the heap nor hold its break up. A region starts with a padding
+ * word and the header of its block, whose size is that of the whole region,
+ * so that the payload is aligned. Mapped blocks lie outside the heap, which
+ * is how free() tells them apart.
+ * ---------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Returns true if bp lies in the heap of the current arena, and
+ * false if it is the payload of a mapped block.
+ */
+static bool in_heap(const void *bp) {
+    return (const char *)bp > (char *)arena->heap_start &&
+           (const char *)bp <= (char *)arena_heap_hi();
+}
+
+/**
+ * @brief Returns the size of the region holding a block of size bytes.
+ */
+static size_t region_size(size_t size) {
+    return round_up(size + dsize, mem_pagesize());
+}
+
+/**
+ * @brief Allocates a block of size bytes in a region of its own.
+ *
+ * @param[in] size
+ * @return The payload of the block, or NULL if out of memory
+ */
+static void *map_block(size_t size) {
+    if (size > (SIZE_MAX >> 1)) {
+        return NULL;
+    }
+
+    size_t length = region_size(size);
+    char *region = mem_map(length);
+    if (region == (void *)-1) {
+        return NULL;
+    }
+
+    block_t *block = (block_t *)(region + wsize);
+    block->header = pack(length, true, true);
+    return header_to_payload(block);
+}
+
+/**
+ * @brief Unmaps the region of a mapped block.
+ */
+static void unmap_block(void *bp) {
+    block_t *block = payload_to_header(bp);
+    mem_unmap((char *)block - wsize, get_size(block));
+}
+
+/**
+ * @brief Resizes a mapped block to size bytes with mem_remap(), which may
+ * move it but never copies it.
+ *
+ * @param[in] bp
+ * @param[in] size
+ * @return The new payload of the block, or NULL if it could not be resized
+ */
+static void *remap_block(void *bp, size_t size) {
+    block_t *block = payload_to_header(bp);
+    size_t length = get_size(block);
+
+    if (size > (SIZE_MAX >> 1)) {
+        return NULL;
+    }
+    if (region_size(size) == length) {
+        return bp;
+    }
+
+    char *region = mem_remap((char *)block - wsize, length, region_size(size));
+    if (region == (void *)-1) {
+        return NULL;
+    }
+
+    block = (block_t *)(region + wsize);
+    block->header = pack(region_size(size), true, true);
+    return header_to_payload(block);
+}
+
+/**
+ * @brief Returns the number of usable bytes of an allocated payload.
+ */
+static size_t usable_size(void *bp) {
+    if (!in_heap(bp)) {
+        return get_size(payload_to_header(bp)) - dsize;
+    }
+    slab_t *slab = find_slab(arena, bp);
+    if (slab != NULL) {
+        return slab->size;
+    }
+    return get_payload_size(payload_to_header(bp));
+}
+
+/**
+ * @brief Checks everything about the heap, the seglist, and blocks
+ *
+ * As described in the writeup.
+ * If and only if there is an error, prints information about the error
+ * and return false.
+ *
+ * @param[in] line
+ * @return True if the heap passes the checks, false otherwise.
+ */
+bool mm_checkheap(int line) {
+
+    block_t *prologue = (block_t *)((word_t *)arena->heap_start - 1);
+    block_t *epilogue = (block_t *)((char *)arena_heap_hi() - 7);
+
+    // Checks prologue for size and alloc bit
+    if ((size_t)prologue < (size_t)arena_heap_lo() ||
+        get_alloc(prologue) == false || get_size(prologue) != 0) {
+        dbg_printf("prologue error line %d\n", line);
+        return false;
+    }
+
+    // Checks epilogue for size and alloc bit
+    if (get_alloc(epilogue) == false || get_size(epilogue) != 0) {
+        dbg_printf("epilogue error line %d\n", line);
+        return false;
+    }
+    if (get_mini(epilogue)) {
+        dbg_printf("epilogue is mini line %d\n", line);
+    }
+
+    block_t *block = arena->heap_start;
+    block_t *next_in_heap;
+    size_t free_count_heap = 0;
+    size_t free_count_list = 0;
+    bool curr_alloc;
+
+    while (block != epilogue) {
         block_t *footer;
         if (!get_alloc(block) && !get_mini(block)) {
             footer = (block_t *)header_to_footer(block);
@@ -1088,9 +2452,9 @@ bool mm_checkheap(int line) {
         }
 
         // Checks boundaries
-        if ((size_t)block < (size_t)heap_start ||
+        if ((size_t)block < (size_t)arena->heap_start ||
             (size_t)block >
-                (size_t)((char *)mem_heap_hi() - 7 - min_block_size)) {
+                (size_t)((char *)arena_heap_hi() - 7 - min_block_size)) {
             dbg_printf("Block out of boundary line %d\n", line);
             return false;
         }
@@ -1129,7 +2493,7 @@ bool mm_checkheap(int line) {
         }
 
         // Checks pointer consistency
-        if (!get_alloc(block)) {
+        if (!get_alloc(block) && get_size(block) <= tree_min) {
             if (!get_mini(block)) {
                 // Checks if previous block points back
                 if (block->prev != NULL && block->prev->next != block) {
@@ -1182,8 +2546,57 @@ bool mm_checkheap(int line) {
     }
 
     // Traverse each bucket in seglist
+    for (size_t bucket = 0; bucket < BUCKET_NUM; bucket++) {
+        bool mapped = (arena->bucket_map >> bucket) & 1;
+        if ((arena->seglist[bucket] != NULL) != mapped) {
+            dbg_printf("Bucket map wrong for bucket %zu line %d\n", bucket,
+                       line);
+            return false;
+        }
+    }
+    // Checks every slab with a free object
+    for (size_t i = 0; i < SLAB_CLASSES; i++) {
+        for (slab_t *slab = arena->slabs[i]; slab != NULL; slab = slab->next) {
+            size_t count = slab_count(slab->size);
+            size_t nfree = 0;
+            for (size_t w = 0; w < SLAB_BITMAP_WORDS; w++) {
+                nfree += (size_t)__builtin_popcountl(slab->free_map[w]);
+            }
+            if (find_slab(arena, slab) != slab ||
+                slab->size != (i + 1) * dsize ||
+                get_size(payload_to_header(slab)) != slab_bytes ||
+                slab->nfree != nfree || nfree == 0 || nfree > count ||
+                (slab->next != NULL && slab->next->prev != slab)) {
+                dbg_printf("Slab %p of class %zu broken line %d\n",
+                           (void *)slab, i, line);
+                return false;
+            }
+        }
+    }
+    // Checks the quick lists
+    size_t quick_bytes = 0;
+    for (size_t i = 0; i < QUICK_LISTS; i++) {
+        size_t count = 0;
+        for (block_t *tmp = arena->quick[i]; tmp != NULL; tmp = tmp->next) {
+            if (!get_alloc(tmp) || !in_heap(header_to_payload(tmp)) ||
+                get_size(tmp) != (i + 1) * dsize ||
+                ++count > arena->quick_count[i]) {
+                dbg_printf("Quick list %zu broken line %d\n", i, line);
+                return false;
+            }
+            quick_bytes += get_size(tmp);
+        }
+        if (count != arena->quick_count[i]) {
+            dbg_printf("Quick list %zu count wrong line %d\n", i, line);
+            return false;
+        }
+    }
+    if (quick_bytes != arena->quick_bytes) {
+        dbg_printf("Quick list bytes wrong line %d\n", line);
+        return false;
+    }
     for (size_t bucket = 1; bucket < BUCKET_NUM; bucket++) {
-        block_t *tmp = seglist[bucket];
+        block_t *tmp = arena->seglist[bucket];
         while (tmp != NULL) {
             free_count_list++;
             if (find_bucket(get_size(tmp)) != bucket) {
@@ -1196,11 +2609,17 @@ bool mm_checkheap(int line) {
         }
     }
     // Traverse bucket 0 in seglist
-    block_t *tmp = seglist[0];
+    block_t *tmp = arena->seglist[0];
     while (tmp != 0) {
         free_count_list++;
         tmp = (block_t *)mini_get_header(tmp);
     }
+    // Checks the tree of large blocks
+    if (is_red(arena->tree) ||
+        check_tree(arena->tree, NULL, NULL, NULL, &free_count_list) < 0) {
+        dbg_printf("Tree of large blocks broken line %d\n", line);
+        return false;
+    }
 
     /** Checks if number of free blocks is consistent when counting
         through the heap and iterating through the seglist*/
@@ -1215,7 +2634,7 @@ bool mm_checkheap(int line) {
 }
 
 /**
- * @brief Initializes the heap.
+ * @brief Initializes the heap of the current arena.
  *
  * Called every time a new heap is required.
  * Initializes all data structures: creates the prologue and the
@@ -1226,7 +2645,7 @@ bool mm_checkheap(int line) {
  */
 bool mm_init(void) {
     // Create the initial empty heap
-    word_t *start = (word_t *)(mem_sbrk(2 * wsize));
+    word_t *start = (word_t *)(arena_sbrk(2 * wsize));
 
     if (start == (void *)-1) {
         return false;
@@ -1236,10 +2655,32 @@ bool mm_init(void) {
     start[1] = pack(0, true, true);  // Heap epilogue (block header)
 
     // Heap starts with first "block header", currently the epilogue
-    heap_start = (block_t *)&(start[1]);
+    arena->heap_start = (block_t *)&(start[1]);
     for (size_t i = 0; i < BUCKET_NUM; i++) {
-        seglist[i] = NULL;
+        arena->seglist[i] = NULL;
+    }
+    arena->bucket_map = 0;
+    arena->tree = NULL;
+    for (size_t i = 0; i < QUICK_LISTS; i++) {
+        arena->quick[i] = NULL;
+        arena->quick_count[i] = 0;
+    }
+    arena->quick_bytes = 0;
+    for (size_t i = 0; i < SLAB_CLASSES; i++) {
+        arena->slabs[i] = NULL;
+        arena->slab_requests[i] = 0;
+    }
+    for (size_t i = 0; i < arena->slab_leaves; i++) {
+        arena->slab_map[i] = NULL;
     }
+    for (size_t i = 0; i < SLAB_LEAF_WORDS; i++) {
+        arena->slab_leaf[i] = 0;
+    }
+    arena->slab_map[0] = arena->slab_leaf;
+    arena->slab_leaves = 1;
+    // The trim state outlives the heap: one set up again grows back to the
+    // same peak, as for each run of a trace in the driver
+    arena->trim_threshold = max(arena->trim_threshold, trim_threshold_min);
 
     // Extend the empty heap with a free block of chunksize bytes
     if (extend_heap(chunksize) == NULL) {
@@ -1265,13 +2706,12 @@ bool mm_init(void) {
 void *malloc(size_t size) {
     dbg_requires(mm_checkheap(__LINE__));
 
-    size_t asize;      // Adjusted block size
-    size_t extendsize; // Amount to extend heap if no fit is found
+    size_t asize; // Adjusted block size
     block_t *block;
     void *bp = NULL;
 
     // Initialize heap if it isn't initialized
-    if (heap_start == NULL) {
+    if (arena->heap_start == NULL) {
         mm_init();
     }
 
@@ -1281,46 +2721,32 @@ void *malloc(size_t size) {
         return bp;
     }
 
+    // Small requests of hot classes are served from slabs, unless they lie
+    // beyond the reach of the page map
+    if (size <= slab_max && use_slab(size) &&
+        (bp = slab_malloc(size)) != NULL) {
+        dbg_ensures(mm_checkheap(__LINE__));
+        return bp;
+    }
+
+    // Large requests get a region of their own
+    if (size >= map_threshold) {
+        bp = map_block(size);
+        dbg_ensures(mm_checkheap(__LINE__));
+        return bp;
+    }
+
     // Adjust block size to include overhead and to meet alignment requirements
     asize = round_up(size + wsize, dsize);
     if (asize < min_block_size) {
         asize = min_block_size;
     }
 
-    // Search the free list for a fit
-    block = find_fit(asize);
-
-    // If no fit is found, request more memory, and then and place the block
-    if (block == NULL) {
-        // Always request at least chunksize
-        extendsize = max(asize, chunksize);
-        block = extend_heap(extendsize);
-        // extend_heap returns an error
-        if (block == NULL) {
-            return bp;
-        }
+    block = alloc_block(asize);
+    if (block != NULL) {
+        bp = header_to_payload(block);
     }
 
-    // The block should be marked as free
-    dbg_assert(!get_alloc(block));
-
-    // Mark block as allocated
-    size_t block_size = get_size(block);
-    bool prev_alloc = get_prev_alloc(block);
-    write_block(block, block_size, true, prev_alloc, get_mini(block));
-
-    delete (block);
-
-    // Try to split the block if too large
-    if (block_size > min_block_size) {
-        block_t *rest = split_block(block, asize);
-
-        if (rest != NULL) {
-            insert(rest);
-        }
-    }
-    bp = header_to_payload(block);
-
     dbg_ensures(mm_checkheap(__LINE__));
     return bp;
 }
@@ -1342,19 +2768,17 @@ void free(void *bp) {
         return;
     }
 
-    block_t *block = payload_to_header(bp);
-    size_t size = get_size(block);
-
-    // The block should be marked as allocated
-    dbg_assert(get_alloc(block));
-
-    // Mark the block as free
-    bool prev_alloc = get_prev_alloc(block);
-    write_block(block, size, false, prev_alloc, get_mini(block));
+    if (!in_heap(bp)) {
+        unmap_block(bp);
+        return;
+    }
 
-    // Try to coalesce the block with its neighbors
-    block = coalesce_block(block);
-    insert(block);
+    slab_t *slab = find_slab(arena, bp);
+    if (slab != NULL) {
+        slab_free(slab, bp);
+    } else {
+        quick_free(payload_to_header(bp));
+    }
 
     dbg_ensures(mm_checkheap(__LINE__));
 }
@@ -1364,16 +2788,18 @@ void free(void *bp) {
  *
  * If ptr is NULL, calls malloc(size)
  * If size is 0, calls free(ptr) and returns NULL
- * Else calls free(ptr) followed by malloc(size), where the
+ * Else resizes the block in place if it can (see resize_block), and
+ * otherwise calls malloc(size) followed by free(ptr), where the
  * contents of the new block will be the same as those of the
- * old block, up to the minimum of the old and new sizes.
+ * old block, up to the minimum of the old and new sizes. A slab
+ * object stays in place while size fits its class, and a mapped block
+ * that stays at least map_threshold bytes is remapped.
  *
  * @param[in] ptr
  * @param[in] size
  * @return A generic pointer to an allocated block payload.
  */
 void *realloc(void *ptr, size_t size) {
-    block_t *block = payload_to_header(ptr);
     size_t copysize;
     void *newptr;
 
@@ -1388,6 +2814,31 @@ void *realloc(void *ptr, size_t size) {
         return malloc(size);
     }
 
+    // Try to resize the block where it is
+    slab_t *slab = find_slab(arena, ptr);
+    if (!in_heap(ptr)) {
+        if (size >= map_threshold &&
+            (newptr = remap_block(ptr, size)) != NULL) {
+            return newptr;
+        }
+    } else if (slab != NULL) {
+        if (size <= slab->size) {
+            return ptr;
+        }
+    } else if (size > wsize) {
+        // A mini block keeps flags in its payload, so never shrink to one
+        size_t asize = round_up(size + wsize, dsize);
+        bool done = resize_block(payload_to_header(ptr), asize);
+        // The block may be followed by blocks held in the quick lists
+        if (!done && quick_flush()) {
+            done = resize_block(payload_to_header(ptr), asize);
+        }
+        dbg_ensures(mm_checkheap(__LINE__));
+        if (done) {
+            return ptr;
+        }
+    }
+
     // Otherwise, proceed with reallocation
     newptr = malloc(size);
 
@@ -1397,7 +2848,7 @@ void *realloc(void *ptr, size_t size) {
     }
 
     // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
+    copysize = usable_size(ptr); // gets size of old payload
     if (size < copysize) {
         copysize = size;
     }
@@ -1442,6 +2893,115 @@ void *calloc(size_t elements, size_t size) {
     return bp;
 }
 
+/**
+ * @brief Gives the free memory at the end of the heap back to the system.
+ *
+ * free() already trims the heap once the free block at its end grows past
+ * trim_threshold, but leaves trim_keep bytes of it. This coalesces the
+ * quick lists, and then releases it all.
+ *
+ * @return True if the heap was shrunk, false otherwise
+ */
+bool mm_trim(void) {
+    dbg_requires(mm_checkheap(__LINE__));
+
+    if (arena->heap_start == NULL) {
+        return false;
+    }
+
+    quick_flush();
+    block_t *epilogue = (block_t *)((char *)arena_heap_hi() - 7);
+    if (get_prev_alloc(epilogue)) {
+        return false;
+    }
+
+    bool trimmed = trim_heap(find_prev(epilogue), 0);
+    dbg_ensures(mm_checkheap(__LINE__));
+    return trimmed;
+}
+
+#ifdef MM_THREADS
+/**
+ * @brief Creates an arena whose heap grows within the given region.
+ *
+ * The arena itself is kept at the start of the region, which must be
+ * 16-byte aligned. Its heap is set up by mm_init() with the arena selected.
+ *
+ * @param[in] region
+ * @param[in] size Size of the region in bytes
+ * @return The new arena, or NULL if the region is too small
+ */
+arena_t *mm_arena_create(void *region, size_t size) {
+    arena_t *new_arena = (arena_t *)region;
+    size_t offset = round_up(sizeof(arena_t), dsize);
+
+    if (size < offset + chunksize) {
+        return NULL;
+    }
+
+    new_arena->heap_start = NULL;
+    new_arena->brk = (char *)region + offset;
+    new_arena->region_end = (char *)region + size;
+    return new_arena;
+}
+
+/**
+ * @brief Returns the arena whose heap is grown with mem_sbrk().
+ */
+arena_t *mm_arena_main(void) {
+    return &main_arena;
+}
+
+/**
+ * @brief Makes the calling thread work on the given arena.
+ *
+ * The caller must hold the lock of the arena for as long as it calls
+ * mm_arena_malloc() and the other functions on it.
+ */
+void mm_arena_select(arena_t *selected) {
+    arena = selected;
+}
+
+/**
+ * @brief Returns true if bp is the payload of a mapped block.
+ *
+ * Mapped blocks belong to no arena. Their payload always starts dsize bytes
+ * into a page, so only payloads there are looked up among the regions,
+ * which needs no arena lock. Pages are a multiple of slab_bytes, which
+ * rules out most other payloads without a call or a division.
+ *
+ * @param[in] bp Payload of an allocated block
+ */
+bool mm_is_mapped(void *bp) {
+    return (uintptr_t)bp % slab_bytes == dsize &&
+           (uintptr_t)bp % mem_pagesize() == dsize && mem_in_region(bp, bp);
+}
+
+/**
+ * @brief Returns the number of usable bytes in an allocated block of an
+ * arena, without its lock.
+ *
+ * The thread holding the lock may be rewriting the page map and the
+ * header of the block meanwhile, but neither the bit of the page of a live
+ * block nor the size in its header changes: only the flags of the header
+ * do, when the block before it is freed or allocated. Both are read and
+ * written atomically with MM_THREADS, and the size of a slab object is read
+ * from its slab, which stays put while the object is live.
+ *
+ * @param[in] owner The arena that allocated the block
+ * @param[in] bp Payload of an allocated block, which must not be mapped
+ */
+size_t mm_usable_size(const arena_t *owner, void *bp) {
+    slab_t *slab = find_slab(owner, bp);
+    if (slab != NULL) {
+        return slab->size;
+    }
+
+    word_t header = load_word(&payload_to_header(bp)->header);
+    return extract_mini(header) ? wsize : extract_size(header) - wsize;
+}
+#endif /* def MM_THREADS */
+
 /*
  *****************************************************************************
  * Do not delete the following super-secret(tm) lines!                       *
@@ -58,6 +58,61 @@ extern void *realloc(void *ptr, size_t size);
 extern void *calloc(size_t nmemb, size_t size);
 #endif
 
+/** @brief State of one heap and its free lists, defined in mm.c */
+typedef struct arena arena_t;
+
+#ifdef MM_THREADS
+
+/* mm.c built for mm-mt.c: the allocator of one arena, see mm-mt.c */
+
+extern void *mm_arena_malloc(size_t size);
+extern void mm_arena_free(void *ptr);
+extern void *mm_arena_realloc(void *ptr, size_t size);
+extern void *mm_arena_calloc(size_t nmemb, size_t size);
+extern bool mm_arena_trim(void);
+
+/**
+ * @brief  Create an arena whose heap grows within a region of memory.
+ *
+ * @param[in] region  The 16-byte aligned start of the region.
+ * @param[in] size  The size of the region in bytes.
+ *
+ * @return  The new arena, or NULL if the region is too small.
+ */
+extern arena_t *mm_arena_create(void *region, size_t size);
+
+/**
+ * @brief  Get the arena whose heap is grown with mem_sbrk().
+ */
+extern arena_t *mm_arena_main(void);
+
+/**
+ * @brief  Make the calling thread's mm_arena_* calls work on an arena.
+ *
+ * @param[in] arena  The arena, whose lock the caller holds.
+ */
+extern void mm_arena_select(arena_t *arena);
+
+/**
+ * @brief  Check whether an allocated block has a mapped region of its own,
+ *         rather than belonging to the heap of an arena.
+ *
+ * @param[in] ptr  A pointer to the beginning of the allocated payload.
+ */
+extern bool mm_is_mapped(void *ptr);
+
+/**
+ * @brief  Get the number of usable bytes of an allocated block, which
+ *         needs no lock.
+ *
+ * @param[in] arena  The arena that allocated the block.
+ * @param[in] ptr  A pointer to the beginning of the payload, which must not
+ *                 be that of a mapped block.
+ */
+extern size_t mm_usable_size(const arena_t *arena, void *ptr);
+
+#endif
+
 /**
  * @brief  Initialize the heap.
  *
@@ -65,6 +120,13 @@ extern void *calloc(size_t nmemb, size_t size);
  */
 extern bool mm_init(void);
 
+/**
+ * @brief  Give the free memory at the end of the heap back to the system.
+ *
+ * @return  True if the heap was shrunk, False otherwise.
+ */
+extern bool mm_trim(void);
+
 /* This is for debugging.  Returns false if error encountered */
 /**
  * @brief  Check the heap for inconsistencies.
@@ -0,0 +1,294 @@
+/**
+ * @file mt-bench.c
+ * @brief Multi-threaded throughput benchmark for mm-mt.c
+ *
+ * Runs the same workload with 1, 2, 4, ... threads up to the -t limit and
+ * reports the malloc/free throughput of each run, and its speedup over one
+ * thread, for the allocator in mm.c behind mm-mt.c and, with -l, for the
+ * C library malloc.
+ *
+ * Each thread owns SLOTS pointers. At every step it picks a random slot,
+ * and either allocates a block of a random size into it, or frees the
+ * block held there. With probability -r percent, the block is instead
+ * handed to the next thread, which frees it, so that a fraction of the
+ * frees are cross-thread frees. Sizes are mostly small (see random_size).
+ *
+ * The number of arenas of mm-mt.c follows the number of CPUs, and can be
+ * set with the MM_ARENAS environment variable.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief Maximum number of threads */
+#define MAX_THREADS 64
+
+/** @brief Number of blocks each thread can hold at once */
+#define SLOTS 1024
+
+/** @brief Steps between checks of a thread's incoming blocks */
+#define DRAIN_INTERVAL 64
+
+/**
+ * @brief Struct representing the allocator being measured
+ */
+typedef struct {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator_t;
+
+/**
+ * @brief Struct representing the state of one benchmark thread
+ */
+typedef struct {
+    int id;
+    uint64_t rng;
+    _Atomic(void *) inbox; /* blocks handed over by the previous thread */
+    void *slots[SLOTS];
+} bench_thread_t;
+
+static const allocator_t allocators[] = {
+    {"mm", mm_malloc, mm_free},
+    {"libc", malloc, free},
+};
+
+/* Parameters of the current run */
+static const allocator_t *alloc;
+static bench_thread_t *threads;
+static int nthreads;
+static long steps = 1000000;
+static unsigned remote_percent = 10;
+
+static pthread_barrier_t start_barrier;
+static pthread_barrier_t done_barrier;
+
+/**
+ * @brief Returns the next pseudo-random number of a thread (xorshift64).
+ */
+static uint64_t next_random(bench_thread_t *t) {
+    t->rng ^= t->rng << 13;
+    t->rng ^= t->rng >> 7;
+    t->rng ^= t->rng << 17;
+    return t->rng;
+}
+
+/**
+ * @brief Returns a random request size.
+ *
+ * 80% of requests are of 16 to 128 bytes, 15% of up to 1 KB, and 5% of
+ * up to 8 KB.
+ */
+static size_t random_size(bench_thread_t *t) {
+    uint64_t r = next_random(t);
+    unsigned percent = (unsigned)(r % 100);
+
+    r >>= 8;
+    if (percent < 80) {
+        return 16 + r % 113;
+    } else if (percent < 95) {
+        return 129 + r % 896;
+    } else {
+        return 1025 + r % 7168;
+    }
+}
+
+/**
+ * @brief Frees the blocks handed over to thread t.
+ */
+static void drain_inbox(bench_thread_t *t) {
+    void *bp = atomic_exchange(&t->inbox, NULL);
+
+    while (bp != NULL) {
+        void *next = *(void **)bp;
+        alloc->free(bp);
+        bp = next;
+    }
+}
+
+/**
+ * @brief Hands a block over to thread t, which will free it.
+ */
+static void send_block(bench_thread_t *t, void *bp) {
+    void *head = atomic_load(&t->inbox);
+
+    do {
+        *(void **)bp = head;
+    } while (!atomic_compare_exchange_weak(&t->inbox, &head, bp));
+}
+
+/**
+ * @brief Runs the workload of one thread.
+ */
+static void *bench_thread(void *arg) {
+    bench_thread_t *t = arg;
+    bench_thread_t *next = &threads[(t->id + 1) % nthreads];
+
+    pthread_barrier_wait(&start_barrier);
+
+    for (long step = 0; step < steps; step++) {
+        uint64_t r = next_random(t);
+        void **slot = &t->slots[r % SLOTS];
+
+        if (*slot == NULL) {
+            size_t size = random_size(t);
+            *slot = alloc->malloc(size);
+            if (*slot == NULL) {
+                fprintf(stderr, "Error: %s malloc(%zu) failed\n", alloc->name,
+                        size);
+                exit(1);
+            }
+            *(char *)*slot = (char)size;
+        } else {
+            if (nthreads > 1 && (r >> 32) % 100 < remote_percent) {
+                send_block(next, *slot);
+            } else {
+                alloc->free(*slot);
+            }
+            *slot = NULL;
+        }
+
+        if (step % DRAIN_INTERVAL == 0) {
+            drain_inbox(t);
+        }
+    }
+
+    for (int i = 0; i < SLOTS; i++) {
+        alloc->free(t->slots[i]);
+        t->slots[i] = NULL;
+    }
+
+    // No more blocks are sent once every thread is past this point
+    pthread_barrier_wait(&done_barrier);
+    drain_inbox(t);
+    return NULL;
+}
+
+/**
+ * @brief Runs the workload on count threads.
+ *
+ * @return The throughput in millions of operations per second
+ */
+static double run(const allocator_t *a, int count) {
+    pthread_t tids[MAX_THREADS];
+    struct timespec start, end;
+
+    alloc = a;
+    nthreads = count;
+    pthread_barrier_init(&start_barrier, NULL, (unsigned)count + 1);
+    pthread_barrier_init(&done_barrier, NULL, (unsigned)count);
+
+    for (int i = 0; i < count; i++) {
+        threads[i].id = i;
+        threads[i].rng = 0x9e3779b97f4a7c15ULL * (uint64_t)(i + 1);
+        atomic_init(&threads[i].inbox, NULL);
+        if (pthread_create(&tids[i], NULL, bench_thread, &threads[i]) != 0) {
+            fprintf(stderr, "Error: cannot create thread\n");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_barrier_destroy(&start_barrier);
+    pthread_barrier_destroy(&done_barrier);
+
+    double secs = (double)(end.tv_sec - start.tv_sec) +
+                  (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)steps * count / secs / 1e6;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-hl] [-n <steps>] [-r <percent>] "
+                    "[-t <threads>]\n",
+            prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         Also measure the libc malloc.\n");
+    fprintf(stderr, "\t-n <steps> Steps per thread (default 1000000).\n");
+    fprintf(stderr, "\t-r <pct>   Percentage of cross-thread frees "
+                    "(default 10).\n");
+    fprintf(stderr, "\t-t <max>   Maximum number of threads "
+                    "(default 2 per CPU).\n");
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nallocs = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "hln:r:t:")) != -1) {
+        switch (c) {
+        case 'l':
+            nallocs = 2;
+            break;
+        case 'n':
+            steps = atol(optarg);
+            break;
+        case 'r':
+            remote_percent = (unsigned)atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (steps < 1 || remote_percent > 100 || max_threads < 1 ||
+        max_threads > MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    threads = calloc((size_t)max_threads, sizeof(*threads));
+    if (threads == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    mem_init(false);
+
+    printf("%ld steps per thread, %u%% cross-thread frees\n\n", steps,
+           remote_percent);
+    printf("%7s", "threads");
+    for (size_t a = 0; a < nallocs; a++) {
+        printf("  %5s Mops/s  speedup", allocators[a].name);
+    }
+    printf("\n");
+
+    double base[2] = {0, 0};
+    for (int count = 1; count <= max_threads; count *= 2) {
+        printf("%7d", count);
+        for (size_t a = 0; a < nallocs; a++) {
+            double mops = run(&allocators[a], count);
+            if (count == 1) {
+                base[a] = mops;
+            }
+            printf("  %12.2f  %6.2fx", mops, mops / base[a]);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    mem_deinit();
+    free(threads);
+    return 0;
+}